@@ -6,12 +6,22 @@
 
 # Import necessary libraries
 import sys
+import os
 import re
+from re import _parser as sre_parse  # For supports_snapshots()
 import signal
+import stat
+import struct
+import ctypes
+import io
+import argparse
+import threading
 
 # Attempt to import Pygments for syntax highlighting
 from pygments import highlight
 from pygments.lexers import get_lexer_by_name
+from pygments.lexer import RegexLexer, ExtendedRegexLexer, LexerContext
+from pygments.filter import apply_filters
 
 # from pygments.formatters import TerminalTrueColorFormatter
 from pygments.formatters import TerminalFormatter
@@ -30,6 +40,7 @@ from pygments.token import (
     Generic,
     Token,
     Whitespace,
+    _TokenType,
 )  # Import Style and Tokens
 
 
@@ -126,7 +137,8 @@ CODE_BG = "\033[48;5;235m"  # Dark grey background for code blocks
 in_code_block = False
 code_language = None
 code_buffer = ""
-code_gen_pos = 0  # Tracks the length of the already emitted highlighted code
+code_lines_out = 0  # Lines of the block already printed
+code_stack = None  # Lexer state after the last code line, for regex lexers
 lexer = None
 # Initialize the formatter once, globally
 # formatter = TerminalFormatter(style=MyAnsiStyle, bg="dark")
@@ -137,7 +149,147 @@ lexer = None
 formatter = Terminal256Formatter(style=MyAnsiStyle)
 
 
-def apply_inline_styles(line):
+# --- Native engine (optional) ---
+# native/build also makes libhlmd.so. Its single-pass span parser can't
+# backtrack on lines full of unmatched '*' or '_' the way the regexes can,
+# and its code lexers resume line by line instead of re-highlighting the
+# whole block for every new line.
+class _NativeBuffer(ctypes.Structure):
+    _fields_ = [
+        ("data", ctypes.c_void_p),
+        ("len", ctypes.c_size_t),
+        ("capacity", ctypes.c_size_t),
+    ]
+
+
+class _NativeSgrAttrs(ctypes.Structure):
+    _fields_ = [
+        (name, ctypes.c_ubyte)
+        for name in ("bold", "faint", "italic", "underline", "blink", "reverse")
+    ] + [("fg", ctypes.c_uint32), ("bg", ctypes.c_uint32)]
+
+
+class _NativeSgr(ctypes.Structure):
+    _fields_ = [
+        ("term", _NativeSgrAttrs),
+        ("want", _NativeSgrAttrs),
+        ("partial", ctypes.c_char * 64),
+        ("partial_len", ctypes.c_size_t),
+    ]
+
+
+def load_native():
+    """Returns libhlmd with its prototypes set, or None if it isn't found."""
+    here = os.path.dirname(os.path.realpath(__file__))
+    candidates = [
+        os.environ.get("HLMD_NATIVE_LIB"),
+        os.path.join(here, "native", "libhlmd.so"),
+        "/usr/local/lib/libhlmd.so",
+    ]
+    for path in candidates:
+        if not path or not os.path.exists(path):
+            continue
+        try:
+            lib = ctypes.CDLL(path)
+        except OSError:
+            continue
+        buffer_p = ctypes.POINTER(_NativeBuffer)
+        lib.hlmd_inline.argtypes = [
+            ctypes.c_char_p,
+            ctypes.c_size_t,
+            ctypes.c_char_p,
+            buffer_p,
+        ]
+        lib.hlmd_inline.restype = ctypes.c_int
+        lib.hlmd_lexer_find.argtypes = [ctypes.c_char_p]
+        lib.hlmd_lexer_find.restype = ctypes.c_void_p
+        lib.hlmd_lex_line.argtypes = [
+            ctypes.c_void_p,
+            ctypes.POINTER(ctypes.c_ubyte),
+            ctypes.c_char_p,
+            ctypes.c_size_t,
+            buffer_p,
+        ]
+        lib.hlmd_lex_line.restype = ctypes.c_int
+        sgr_p = ctypes.POINTER(_NativeSgr)
+        lib.hlmd_sgr_init.argtypes = [sgr_p]
+        lib.hlmd_sgr_init.restype = None
+        lib.hlmd_sgr_filter.argtypes = [
+            sgr_p,
+            ctypes.c_char_p,
+            ctypes.c_size_t,
+            buffer_p,
+        ]
+        lib.hlmd_sgr_filter.restype = ctypes.c_int
+        lib.hlmd_sgr_finish.argtypes = [sgr_p, buffer_p]
+        lib.hlmd_sgr_finish.restype = ctypes.c_int
+        return lib
+    return None
+
+
+native = load_native()
+native_buffer = _NativeBuffer()  # Reused for every line, never freed
+native_lexer = None  # Native lexer for the current code block, if any
+native_lex_state = ctypes.c_ubyte(0)
+
+
+def native_output():
+    return ctypes.string_at(native_buffer.data, native_buffer.len).decode(
+        "utf-8", "replace"
+    )
+
+
+class SgrWriter:
+    """Text stream that passes everything through the native SGR tracker.
+
+    Style changes that don't change anything (a reset followed by the same
+    color, adjacent tokens in one style) never reach the terminal.
+    """
+
+    def __init__(self, stream):
+        self.stream = stream
+        self.state = _NativeSgr()
+        self.buffer = _NativeBuffer()  # Reused for every write, never freed
+        native.hlmd_sgr_init(ctypes.byref(self.state))
+
+    def _emit(self):
+        if self.buffer.len:
+            data = ctypes.string_at(self.buffer.data, self.buffer.len)
+            self.stream.write(data.decode("utf-8", "replace"))
+        self.buffer.len = 0
+
+    def write(self, text):
+        data = text.encode("utf-8")
+        state, buffer = ctypes.byref(self.state), ctypes.byref(self.buffer)
+        if not native.hlmd_sgr_filter(state, data, len(data), buffer):
+            raise MemoryError("hlmd_sgr_filter")
+        self._emit()
+        return len(text)
+
+    def finish(self):
+        native.hlmd_sgr_finish(ctypes.byref(self.state), ctypes.byref(self.buffer))
+        self._emit()
+        self.flush()
+
+    def flush(self):
+        self.stream.flush()
+
+
+def apply_inline_styles(line, base=""):
+    """Applies bold, italic, and inline code styles.
+
+    base is the style of the surrounding text (e.g. a header), which the
+    native parser restores after each span.
+    """
+    if native is not None:
+        data = line.encode("utf-8")
+        native_buffer.len = 0
+        if native.hlmd_inline(data, len(data), base.encode(), native_buffer):
+            return native_output()
+    return apply_inline_styles_regex(line)
+
+
+def apply_inline_styles_regex(line):
     """Applies bold, italic, and inline code styles using regex."""
     # Bold (**text** or __text__)
     line = re.sub(r"\*\*(.*?)\*\*", rf"{BOLD}{BOLD_COLOR}\1{RESET}", line)
@@ -157,9 +309,196 @@ def apply_inline_styles(line):
     return line
 
 
+def lex_line(lexer, line, stack):
+    """Lexes one code line starting in the state stack the last one ended in.
+
+    Regex lexers keep all their state in that stack, so it is a snapshot
+    the next line can resume from: every line is lexed once instead of the
+    whole block being re-highlighted for each new line. Returns the line's
+    tokens and the stack it ends in.
+
+    A rule whose regex has to reach into the next line (a C block comment
+    matched by a single regex, say) can't match here, where it only sees one
+    line. supports_snapshots() keeps lexers with such rules away from this.
+    """
+    if not line.endswith("\n"):
+        line += "\n"
+
+    if isinstance(lexer, ExtendedRegexLexer):
+        ctx = LexerContext(line, 0, list(stack))
+        tokens = lexer.get_tokens_unprocessed(context=ctx)
+        tokens = [(ttype, value) for _, ttype, value in tokens]
+        return list(apply_filters(tokens, lexer.filters, lexer)), tuple(ctx.stack)
+
+    # RegexLexer.get_tokens_unprocessed(), keeping hold of the final stack
+    tokens = []
+    statestack = list(stack)
+    tokendefs = lexer._tokens
+    statetokens = tokendefs[statestack[-1]]
+    pos = 0
+    while True:
+        for rexmatch, action, new_state in statetokens:
+            m = rexmatch(line, pos)
+            if not m:
+                continue
+            if action is not None:
+                if type(action) is _TokenType:
+                    tokens.append((action, m.group()))
+                else:
+                    tokens.extend((t, v) for _, t, v in action(lexer, m))
+            pos = m.end()
+            if new_state is not None:
+                if isinstance(new_state, tuple):
+                    for state in new_state:
+                        if state == "#pop":
+                            if len(statestack) > 1:
+                                statestack.pop()
+                        elif state == "#push":
+                            statestack.append(statestack[-1])
+                        else:
+                            statestack.append(state)
+                elif isinstance(new_state, int):
+                    if abs(new_state) >= len(statestack):
+                        del statestack[1:]
+                    else:
+                        del statestack[new_state:]
+                elif new_state == "#push":
+                    statestack.append(statestack[-1])
+                statetokens = tokendefs[statestack[-1]]
+            break
+        else:
+            if pos >= len(line):
+                break
+            if line[pos] == "\n":
+                # At EOL, reset state to "root"
+                statestack = ["root"]
+                statetokens = tokendefs["root"]
+                tokens.append((Whitespace, "\n"))
+            else:
+                tokens.append((Error, line[pos]))
+            pos += 1
+    return list(apply_filters(tokens, lexer.filters, lexer)), tuple(statestack)
+
+
+# Character classes that match a newline (negated ones are handled in
+# class_matches_newline()). \s is left out: whitespace split at line ends
+# renders the same.
+NEWLINE_CATEGORIES = {
+    sre_parse.CATEGORY_NOT_DIGIT,
+    sre_parse.CATEGORY_NOT_WORD,
+    sre_parse.CATEGORY_UNI_NOT_DIGIT,
+    sre_parse.CATEGORY_UNI_NOT_WORD,
+}
+REPEAT_OPS = {
+    sre_parse.MAX_REPEAT,
+    sre_parse.MIN_REPEAT,
+    sre_parse.POSSESSIVE_REPEAT,
+}
+
+
+def class_matches_newline(items):
+    negate = hit = False
+    for op, av in items:
+        if op is sre_parse.NEGATE:
+            negate = True
+        elif op is sre_parse.LITERAL:
+            hit |= av == 10
+        elif op is sre_parse.RANGE:
+            hit |= av[0] <= 10 <= av[1]
+        elif op is sre_parse.CATEGORY:
+            hit |= av in NEWLINE_CATEGORIES
+    return hit != negate
+
+
+def scan_regex(items, dotall):
+    """Walks a parsed regex for anything it must match after a newline.
+
+    Returns whether it needs more text after a newline it consumed, whether
+    it can consume a newline at all, and its minimum width.
+    """
+    newline = False
+    width = 0
+    for op, av in items:
+        if op is sre_parse.LITERAL:
+            spans, nl, w = False, av == 10, 1
+        elif op is sre_parse.NOT_LITERAL:
+            spans, nl, w = False, av != 10, 1
+        elif op is sre_parse.ANY:
+            spans, nl, w = False, dotall, 1
+        elif op is sre_parse.IN:
+            spans, nl, w = False, class_matches_newline(av), 1
+        elif op in REPEAT_OPS:
+            lo, _, sub = av
+            spans, nl, w = scan_regex(sub, dotall)
+            w *= lo
+        elif op is sre_parse.SUBPATTERN:
+            _, add, remove, sub = av
+            sub_dotall = (dotall or add & re.DOTALL) and not remove & re.DOTALL
+            spans, nl, w = scan_regex(sub, bool(sub_dotall))
+        elif op is sre_parse.ATOMIC_GROUP:
+            spans, nl, w = scan_regex(av, dotall)
+        elif op in (sre_parse.BRANCH, sre_parse.GROUPREF_EXISTS):
+            alts = av[1] if op is sre_parse.BRANCH else av[1:]
+            found = [scan_regex(alt, dotall) for alt in alts if alt is not None]
+            spans = any(f[0] for f in found)
+            nl = any(f[1] for f in found)
+            w = min(f[2] for f in found) if op is sre_parse.BRANCH else 0
+        elif op is sre_parse.GROUPREF:
+            spans, nl, w = False, False, 1  # Whatever the group matched
+        else:
+            continue  # Anchors and lookarounds consume nothing
+        if spans or (newline and w > 0):
+            return True, True, width
+        newline |= nl
+        width += w
+    return False, newline, width
+
+
+def regex_spans_lines(regex):
+    """Whether a match of regex can need text past a newline."""
+    parsed = sre_parse.parse(regex.pattern, regex.flags)
+    dotall = bool(parsed.state.flags & re.DOTALL)
+    return scan_regex(parsed, dotall)[0]
+
+
+snapshot_support = {}  # Lexer class: whether lex_line() can drive it
+
+
+def supports_snapshots(lexer):
+    """Whether lex_line() can resume this lexer from its state stack.
+
+    Lexers that override get_tokens_unprocessed() post-process tokens or
+    keep state outside the stack (e.g. YAML's indentation), and lexers with
+    a rule that spans lines (block comments, multi-line strings and the
+    like, as in most C-family lexers) would go wrong one line at a time. Both
+    are re-highlighted as a whole instead.
+    """
+    cls = type(lexer)
+    if cls not in snapshot_support:
+        snapshot_support[cls] = False
+        for base in (ExtendedRegexLexer, RegexLexer):
+            if isinstance(lexer, base):
+                own = cls.get_tokens_unprocessed is base.get_tokens_unprocessed
+                snapshot_support[cls] = own and not any(
+                    regex_spans_lines(rexmatch.__self__)
+                    for rules in lexer._tokens.values()
+                    for rexmatch, _, _ in rules
+                    if hasattr(rexmatch, "__self__")
+                )
+                break
+    return snapshot_support[cls]
+
+
+def format_tokens(tokens):
+    out = io.StringIO()
+    formatter.format(iter(tokens), out)
+    return out.getvalue()
+
+
 def process_line(line):
     """Processes a single line of Markdown input."""
-    global in_code_block, code_language, code_buffer, code_gen_pos, formatter, lexer
+    global in_code_block, code_language, code_buffer, code_lines_out, formatter, lexer
+    global native_lexer, code_stack
 
     # --- Fenced Code Blocks ---
     code_block_match = re.match(r"^\s*```\s*(\w*)\s*$", line)
@@ -171,7 +510,8 @@ def process_line(line):
             lexer = None  # Reset lexer
             code_buffer = ""  # Reset buffer
             code_language = None
-            code_gen_pos = 0  # Reset position tracker
+            code_lines_out = 0  # Reset position tracker
+            code_stack = None
             print(RESET, end="")  # Ensure styles are reset after code block
             return  # Don't print the closing ``` line itself
         else:
@@ -179,20 +519,34 @@ def process_line(line):
             in_code_block = True
             code_language = code_block_match.group(1) or None
             code_buffer = ""  # Clear buffer for new block
-            code_gen_pos = 0  # Reset position tracker
+            code_lines_out = 0  # Reset position tracker
+            code_stack = None
             lexer = None  # Reset lexer, will be determined on first line of code
+            native_lexer = None
+            if native is not None and code_language:
+                native_lexer = native.hlmd_lexer_find(code_language.encode())
+                native_lex_state.value = 0
             # print(CODE_BG, end="") # Optional: Start with a background color immediately
             return  # Don't print the opening ``` line itself
 
     if in_code_block:
+        if native_lexer:
+            data = line.encode("utf-8")
+            native_buffer.len = 0
+            if native.hlmd_lex_line(
+                native_lexer, native_lex_state, data, len(data), native_buffer
+            ):
+                print(native_output(), end="")
+                return
+
         # Determine lexer on the first line inside the block
         if lexer is None and code_language:
             try:
-                lexer = get_lexer_by_name(code_language)
+                lexer = get_lexer_by_name(code_language, stripnl=False)
             except ClassNotFound:
                 # Use a default or plain text lexer if specified one not found
                 try:
-                    lexer = get_lexer_by_name("text")  # Fallback lexer
+                    lexer = get_lexer_by_name("text", stripnl=False)
                 except ClassNotFound:  # Should not happen for 'text'
                     print(f"# Fallback lexer 'text' not found.", file=sys.stderr)
                     # If even text lexer fails, we cannot highlight
@@ -201,31 +555,39 @@ def process_line(line):
 
         elif lexer is None:  # No language specified
             try:
-                lexer = get_lexer_by_name("text")  # Default to plain text
+                lexer = get_lexer_by_name("text", stripnl=False)
             except ClassNotFound:
                 print(f"# Default lexer 'text' not found.", file=sys.stderr)
                 print(line.rstrip())  # Print raw line
                 return
 
-        # Accumulate line, highlight the whole buffer, extract and print the new part
+        # Regex lexers resume from the previous line's state snapshot
+        if code_stack is None and supports_snapshots(lexer):
+            code_stack = ("root",)
+        if code_stack is not None:
+            try:
+                tokens, code_stack = lex_line(lexer, line, code_stack)
+                print(format_tokens(tokens), end="")
+            except Exception as e:
+                print(f"# Error during line highlighting: {e}{RESET}", file=sys.stderr)
+                print(line.rstrip())
+                code_stack = ("root",)
+            return
+
+        # Other lexers: accumulate line, highlight the whole buffer, extract
+        # and print the new part
         code_buffer += line
         try:
             # Highlight the cumulative buffer
             full_highlighted_output = highlight(code_buffer, lexer, formatter)
 
-            # Extract the newly highlighted portion
-            # This assumes the formatter doesn't drastically change the length of already processed parts
-            # (which is generally true for terminal formatters)
-            new_highlighted_chunk = full_highlighted_output[code_gen_pos:]
-
-            # Print the new chunk. The highlight function preserves newlines,
-            # and end="" prevents print() from adding an extra one.
-            print(new_highlighted_chunk, end="")
-
-            # Update the position tracker
-            # Store the length of the full highlighted output *including* any
-            # newline added by the formatter at the end.
-            code_gen_pos = len(full_highlighted_output)
+            # Print the lines not printed yet. Output lines match input lines
+            # (stripnl=False keeps blank ones), while earlier lines may have
+            # changed length since they were printed, e.g. once a block
+            # comment that they open is closed.
+            lines = full_highlighted_output.splitlines(keepends=True)
+            print("".join(lines[code_lines_out:]), end="")
+            code_lines_out = len(lines)
 
         except Exception as e:
             # Fallback for any highlighting error - print raw line for this step
@@ -233,8 +595,7 @@ def process_line(line):
                 f"# Error during incremental highlighting: {e}{RESET}", file=sys.stderr
             )
             print(line.rstrip(), end="")  # Print raw line content
-            # Try to keep buffer consistent, but highlighting is likely broken now
-            code_gen_pos += len(line)  # Rough estimate
+            code_lines_out += 1
 
         return  # Line processed within code block
 
@@ -243,7 +604,8 @@ def process_line(line):
     if header_match:
         level = len(header_match.group(1))
         text = header_match.group(2)
-        styled_text = apply_inline_styles(text)  # Apply styles within header
+        # Apply styles within header
+        styled_text = apply_inline_styles(text, BOLD + HEADER_COLOR)
         print(f"{BOLD}{HEADER_COLOR}{'#' * level} {styled_text}{RESET}")
         return
 
@@ -278,6 +640,8 @@ def main():
     except AttributeError:
         # sys.stdin/stdout might not have reconfigure (e.g., in some environments)
         pass
+    if native is not None:
+        sys.stdout = SgrWriter(sys.stdout)
 
     try:
         for line in sys.stdin:
@@ -288,6 +652,8 @@ def main():
             print(f"\n--- Code block potentially truncated ---{RESET}", file=sys.stderr)
         # No need for the explicit end-of-stream highlighting block anymore,
         # as highlighting is done incrementally.
+        if isinstance(sys.stdout, SgrWriter):
+            sys.stdout.finish()
 
     except BrokenPipeError:
         # Handle cases where the reading pipe is closed (e.g., piping to `head`)
@@ -299,5 +665,209 @@ def main():
         sys.exit(1)
 
 
+# --- Daemon mode ---
+# `hlmd-st --daemon` pays for the interpreter, the Pygments imports and lexer
+# setup once, then serves every stream after that. hlmd-st-client (native/
+# client.c) connects over a Unix socket and hands over its stdin, stdout and
+# stderr; a worker forked from the warm daemon runs main() on those fds with
+# a fresh copy of the state above. Nothing but status bytes goes through the
+# socket: "+" once the worker has the stream, then its exit code.
+DAEMON_HELLO = b"hlmd-st 1\n"
+DAEMON_ENV = ("COLUMNS", "LINES", "TERM")  # The client's, for each stream
+WARM_LANGUAGES = [
+    "python",
+    "c",
+    "cpp",
+    "rust",
+    "go",
+    "javascript",
+    "typescript",
+    "bash",
+    "json",
+    "yaml",
+    "toml",
+    "diff",
+    "html",
+]
+
+
+def fallback_socket_dir():
+    """Per-user directory under /tmp, for when there is no XDG_RUNTIME_DIR."""
+    return f"/tmp/hlmd-st-{os.getuid()}"
+
+
+def default_socket_path():
+    if os.environ.get("HLMD_ST_SOCKET"):
+        return os.environ["HLMD_ST_SOCKET"]
+    if os.environ.get("XDG_RUNTIME_DIR"):
+        return os.path.join(os.environ["XDG_RUNTIME_DIR"], "hlmd-st.sock")
+    return os.path.join(fallback_socket_dir(), "hlmd-st.sock")
+
+
+def make_private_dir(path):
+    """Creates path with mode 0700, or checks that it is already ours alone.
+
+    Anyone can create the name first in /tmp, so a directory that isn't this
+    user's, is a symlink or is open to others is refused.
+    """
+    try:
+        os.mkdir(path, 0o700)
+    except FileExistsError:
+        pass
+    st = os.lstat(path)
+    if (
+        not stat.S_ISDIR(st.st_mode)
+        or st.st_uid != os.getuid()
+        or st.st_mode & 0o077
+    ):
+        print(f"hlmd-st: {path} is not a private directory", file=sys.stderr)
+        return False
+    return True
+
+
+def peer_uid(conn):
+    """User id of the process at the other end of a Unix socket, or None."""
+    import socket
+
+    if not hasattr(socket, "SO_PEERCRED"):
+        return None
+    creds = conn.getsockopt(socket.SOL_SOCKET, socket.SO_PEERCRED, 12)
+    _, uid, _ = struct.unpack("3i", creds)
+    return uid
+
+
+def warm_up():
+    """Imports and compiles what a typical stream needs, before forking."""
+    for name in WARM_LANGUAGES:
+        try:
+            warm = get_lexer_by_name(name, stripnl=False)
+            highlight("x\n", warm, formatter)
+            supports_snapshots(warm)
+        except ClassNotFound:
+            pass
+    apply_inline_styles("**a** _b_ `c`")
+
+
+def serve_stream(conn, request, fds):
+    """Runs one stream in a forked worker, on the client's own fds."""
+    for key in DAEMON_ENV:
+        os.environ.pop(key, None)
+    for item in request.split(b"\0"):
+        key, sep, value = item.decode("utf-8", "replace").partition("=")
+        if sep and key in DAEMON_ENV:
+            os.environ[key] = value
+    for target, fd in enumerate(fds):
+        os.dup2(fd, target)
+        os.close(fd)
+    sys.stdin = os.fdopen(0, "r", encoding="utf-8", closefd=False)
+    sys.stdout = os.fdopen(1, "w", encoding="utf-8", closefd=False)
+    sys.stderr = os.fdopen(2, "w", encoding="utf-8", closefd=False)
+
+    # A client that goes away (Ctrl+C, killed) takes its stream with it
+    def watch_client():
+        conn.recv(1)
+        os._exit(0)
+
+    threading.Thread(target=watch_client, daemon=True).start()
+    conn.sendall(b"+")
+
+    status = 0
+    try:
+        main()
+    except SystemExit as e:
+        status = e.code if isinstance(e.code, int) else int(e.code is not None)
+    try:
+        sys.stdout.flush()
+        sys.stderr.flush()
+    except OSError:
+        pass
+    conn.sendall(bytes([status & 0xFF]))
+    os._exit(status)
+
+
+def daemon(path):
+    import fcntl
+    import socket
+
+    if os.path.dirname(path) == fallback_socket_dir():
+        if not make_private_dir(fallback_socket_dir()):
+            return 1
+
+    # One daemon per socket: the others see the lock taken and leave. The
+    # lock is never followed through a symlink or truncated.
+    flags = os.O_WRONLY | os.O_CREAT | os.O_NOFOLLOW | os.O_CLOEXEC
+    try:
+        lock = os.open(path + ".lock", flags, 0o600)
+    except OSError as e:
+        print(f"hlmd-st: can't open {path}.lock: {e}", file=sys.stderr)
+        return 1
+    try:
+        fcntl.flock(lock, fcntl.LOCK_EX | fcntl.LOCK_NB)
+    except BlockingIOError:
+        return 0
+    try:
+        os.unlink(path)  # Left over from a daemon that didn't clean up
+    except FileNotFoundError:
+        pass
+
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    umask = os.umask(0o077)  # Only this user may hand us their terminal
+    try:
+        server.bind(path)
+    finally:
+        os.umask(umask)
+    server.listen(64)
+
+    warm_up()
+    signal.signal(signal.SIGCHLD, signal.SIG_IGN)  # Workers reap themselves
+    signal.signal(signal.SIGINT, signal.SIG_DFL)
+    signal.signal(signal.SIGTERM, lambda sig, frame: sys.exit(0))
+    try:
+        while True:
+            conn, _ = server.accept()
+            # The socket is 0600, but HLMD_ST_SOCKET may be anywhere
+            uid = peer_uid(conn)
+            if uid is not None and uid != os.getuid():
+                conn.close()
+                continue
+            try:
+                request, fds, _, _ = socket.recv_fds(conn, 4096, 3)
+            except OSError:
+                conn.close()
+                continue
+            if request.startswith(DAEMON_HELLO) and len(fds) == 3:
+                try:
+                    if os.fork() == 0:
+                        try:
+                            server.close()
+                            signal.signal(signal.SIGCHLD, signal.SIG_DFL)
+                            serve_stream(conn, request[len(DAEMON_HELLO) :], fds)
+                        finally:
+                            os._exit(1)  # Never back into the accept loop
+                except OSError as e:
+                    # The client runs the stream itself when it gets no "+"
+                    print(f"hlmd-st: fork failed: {e}", file=sys.stderr)
+            for fd in fds:
+                os.close(fd)
+            conn.close()
+    finally:
+        os.unlink(path)
+
+
 if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="streaming markdown highlighter")
+    parser.add_argument(
+        "--daemon",
+        action="store_true",
+        help="stay running and serve hlmd-st-client streams over a Unix socket",
+    )
+    parser.add_argument(
+        "--socket",
+        default=default_socket_path(),
+        help="daemon socket (default: $HLMD_ST_SOCKET, "
+        "$XDG_RUNTIME_DIR/hlmd-st.sock or /tmp/hlmd-st-$UID/hlmd-st.sock)",
+    )
+    args = parser.parse_args()
+    if args.daemon:
+        sys.exit(daemon(args.socket))
     main()
@@ -0,0 +1,36 @@
+#include "buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void buffer_init(buffer_t *buf) {
+	buf->data = NULL;
+	buf->len = 0;
+	buf->capacity = 0;
+}
+
+int buffer_append(buffer_t *buf, const char *data, size_t len) {
+	if (buf->len + len > buf->capacity) {
+		size_t new_capacity =
+		    buf->capacity ? buf->capacity * 2 : READ_CHUNK_SIZE;
+		while (new_capacity < buf->len + len) {
+			new_capacity *= 2;
+		}
+		char *new_data = realloc(buf->data, new_capacity);
+		if (!new_data) return 0;  // Failure
+		buf->data = new_data;
+		buf->capacity = new_capacity;
+	}
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+	return 1;  // Success
+}
+
+int buffer_append_str(buffer_t *buf, const char *str) {
+	return buffer_append(buf, str, strlen(str));
+}
+
+void buffer_free(buffer_t *buf) {
+	free(buf->data);
+	buffer_init(buf);  // Reset state
+}
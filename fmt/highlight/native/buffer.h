@@ -0,0 +1,28 @@
+#ifndef HLMD_BUFFER_H
+#define HLMD_BUFFER_H
+
+#include <stddef.h>  // For size_t
+
+#define READ_CHUNK_SIZE 4096
+
+// Structure to hold dynamically growing buffer
+typedef struct {
+	char *data;
+	size_t len;
+	size_t capacity;
+} buffer_t;
+
+// Initialize a buffer
+void buffer_init(buffer_t *buf);
+
+// Append data to a buffer, reallocating if necessary
+// Returns 1 on success, 0 on allocation failure
+int buffer_append(buffer_t *buf, const char *data, size_t len);
+
+// Append a NUL-terminated string
+int buffer_append_str(buffer_t *buf, const char *str);
+
+// Free buffer memory
+void buffer_free(buffer_t *buf);
+
+#endif
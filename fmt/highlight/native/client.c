@@ -0,0 +1,201 @@
+// hlmd-st-client: drop-in for hlmd-st that hands the stream to a running
+// `hlmd-st --daemon` instead of starting Python and Pygments again
+//
+// usage: hlmd-st-client < markdown
+//
+// The client passes its stdin, stdout and stderr to the daemon over a Unix
+// socket (SCM_RIGHTS) and waits; the daemon's worker reads and writes them
+// directly, so no stream data goes through this process. Without a daemon
+// it starts one in the background for the next stream and runs hlmd-st
+// itself for this one (HLMD_ST_NO_AUTOSTART=1 to only fall back).
+//
+// Environment:
+//   HLMD_ST_SOCKET        socket path, as for hlmd-st --daemon
+//   HLMD_ST               hlmd-st command to start or fall back to
+//   HLMD_ST_NO_AUTOSTART  don't start a daemon when none is running
+
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE  // For CMSG_*, setsid() and struct ucred declarations
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Must match DAEMON_HELLO and DAEMON_ENV in hlmd-st.py
+#define HELLO "hlmd-st 1\n"
+static const char *const passed_env[] = {"COLUMNS", "LINES", "TERM"};
+
+static void socket_path(char *path, size_t size) {
+	const char *env = getenv("HLMD_ST_SOCKET");
+	const char *runtime = getenv("XDG_RUNTIME_DIR");
+	if (env && *env) {
+		snprintf(path, size, "%s", env);
+	} else if (runtime && *runtime) {
+		snprintf(path, size, "%s/hlmd-st.sock", runtime);
+	} else {
+		// A directory of its own (mode 0700), created by the daemon
+		snprintf(path, size, "/tmp/hlmd-st-%d/hlmd-st.sock", (int)getuid());
+	}
+}
+
+static const char *hlmd_st_command(void) {
+	const char *cmd = getenv("HLMD_ST");
+	return cmd && *cmd ? cmd : "hlmd-st";
+}
+
+// Whether the other end of sock runs as this user. Whoever listens gets our
+// terminal, and a path in /tmp can be bound by anyone first.
+static int peer_is_us(int sock) {
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1) return 0;
+	return cred.uid == getuid();
+#else
+	uid_t uid;
+	gid_t gid;
+	if (getpeereid(sock, &uid, &gid) == -1) return 0;
+	return uid == getuid();
+#endif
+}
+
+// Connected socket to the daemon, -1 if none is listening or it isn't ours
+static int connect_daemon(const char *path) {
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) return -1;
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		close(fd);
+		return -1;
+	}
+	if (!peer_is_us(fd)) {
+		fprintf(stderr, "hlmd-st-client: %s belongs to another user\n", path);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Send the hello, the environment the worker should see and our stdio fds
+// Returns 1 on success, 0 on failure
+static int send_request(int sock) {
+	char msg[1024];
+	size_t len = snprintf(msg, sizeof(msg), "%s", HELLO);
+	for (size_t i = 0; i < sizeof(passed_env) / sizeof(*passed_env); i++) {
+		const char *value = getenv(passed_env[i]);
+		if (!value) continue;
+		int n = snprintf(msg + len, sizeof(msg) - len, "%s=%s", passed_env[i],
+		                 value);
+		if (n < 0 || (size_t)n + 1 >= sizeof(msg) - len) break;
+		len += n + 1;  // Keep the NUL as separator
+	}
+
+	int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+	union {
+		char buf[CMSG_SPACE(sizeof(fds))];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof(control));
+	struct iovec iov = {.iov_base = msg, .iov_len = len};
+	struct msghdr mh = {
+	    .msg_iov = &iov,
+	    .msg_iovlen = 1,
+	    .msg_control = control.buf,
+	    .msg_controllen = sizeof(control.buf),
+	};
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+	ssize_t n;
+	do {
+		n = sendmsg(sock, &mh, 0);
+	} while (n == -1 && errno == EINTR);
+	return n == (ssize_t)len;
+}
+
+// One status byte from the daemon, -1 on EOF or error
+static int read_status(int sock) {
+	unsigned char c;
+	ssize_t n;
+	do {
+		n = read(sock, &c, 1);
+	} while (n == -1 && errno == EINTR);
+	return n == 1 ? c : -1;
+}
+
+// Start `hlmd-st --daemon` detached from this session, for the next stream
+static void start_daemon(void) {
+	pid_t pid = fork();
+	if (pid == -1) return;
+	if (pid == 0) {
+		setsid();
+		if (fork() != 0) _exit(0);  // The daemon is reparented to init
+		int null = open("/dev/null", O_RDWR);
+		if (null != -1) {
+			dup2(null, STDIN_FILENO);
+			dup2(null, STDOUT_FILENO);
+			dup2(null, STDERR_FILENO);
+			if (null > STDERR_FILENO) close(null);
+		}
+		const char *cmd = hlmd_st_command();
+		execlp(cmd, cmd, "--daemon", (char *)NULL);
+		_exit(127);
+	}
+	waitpid(pid, NULL, 0);
+}
+
+// Run this stream in a plain hlmd-st; stdin hasn't been touched yet
+static int run_fallback(void) {
+	const char *cmd = hlmd_st_command();
+	execlp(cmd, cmd, (char *)NULL);
+	fprintf(stderr, "hlmd-st-client: can't run %s: %s\n", cmd,
+	        strerror(errno));
+	return 127;
+}
+
+int main(void) {
+	signal(SIGPIPE, SIG_IGN);
+
+	// A closed stdio fd would be reused by the socket and handed over as one
+	for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; fd++) {
+		if (fcntl(fd, F_GETFD) == -1 && open("/dev/null", O_RDWR) != fd) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	char path[4096];
+	socket_path(path, sizeof(path));
+	int sock = connect_daemon(path);
+	if (sock == -1) {
+		const char *no_autostart = getenv("HLMD_ST_NO_AUTOSTART");
+		if (!no_autostart || !*no_autostart) start_daemon();
+		return run_fallback();
+	}
+
+	// Until the worker says "+" it hasn't read anything from stdin, so the
+	// stream can still be run here
+	if (!send_request(sock) || read_status(sock) != '+') {
+		close(sock);
+		return run_fallback();
+	}
+
+	int status = read_status(sock);
+	close(sock);
+	if (status == -1) {
+		fprintf(stderr, "hlmd-st-client: daemon worker died\n");
+		return EXIT_FAILURE;
+	}
+	return status;
+}
@@ -0,0 +1,133 @@
+// gen_keywords: build-time generator for the keyword tables in keywords.h
+//
+// usage: gen_keywords < keywords.def > keywords.h
+//
+// For each language it finds the smallest power-of-two table and a seed for
+// hlmd_kw_hash() under which every keyword gets its own slot, and writes the
+// table out as static data.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kwhash.h"
+
+#define MAX_WORDS 512
+#define MAX_SEEDS 1000000
+
+typedef struct {
+	char *word;
+	char *token;
+} entry;
+
+static char lang[64];
+static entry words[MAX_WORDS];
+static int nwords;
+
+static int find_seed(uint32_t mask, uint32_t *seed_out, int *slot_of) {
+	unsigned char *used = malloc(mask + 1);
+	if (!used) return 0;
+	for (uint32_t seed = 0; seed < MAX_SEEDS; seed++) {
+		memset(used, 0, mask + 1);
+		int ok = 1;
+		for (int i = 0; i < nwords && ok; i++) {
+			uint32_t slot =
+			    hlmd_kw_hash(words[i].word, strlen(words[i].word), seed) & mask;
+			if (used[slot]) ok = 0;
+			used[slot] = 1;
+			slot_of[i] = slot;
+		}
+		if (ok) {
+			*seed_out = seed;
+			free(used);
+			return 1;
+		}
+	}
+	free(used);
+	return 0;
+}
+
+// Write the table for the language collected so far
+static int flush_lang(void) {
+	if (!lang[0]) return 1;
+
+	int slot_of[MAX_WORDS];
+	uint32_t size = 4;
+	while (size < 2 * (uint32_t)nwords) size *= 2;
+	uint32_t seed = 0;
+	while (!find_seed(size - 1, &seed, slot_of)) {
+		if (size > 1 << 16) {
+			fprintf(stderr, "gen_keywords: no perfect hash for '%s'\n", lang);
+			return 0;
+		}
+		size *= 2;
+	}
+
+	printf("static const hlmd_keyword kw_%s_slots[%u] = {\n", lang, size);
+	for (int i = 0; i < nwords; i++) {
+		printf("    [%d] = {\"%s\", %zu, HLMD_TOK_%s},\n", slot_of[i],
+		       words[i].word, strlen(words[i].word), words[i].token);
+	}
+	printf("};\n");
+	printf("static const hlmd_keyword_table kw_%s = ", lang);
+	printf("{%uu, %uu, kw_%s_slots};\n\n", seed, size - 1, lang);
+
+	for (int i = 0; i < nwords; i++) {
+		free(words[i].word);
+		free(words[i].token);
+	}
+	nwords = 0;
+	return 1;
+}
+
+int main(void) {
+	printf("// Generated by gen_keywords from keywords.def, do not edit\n\n");
+	printf("#include \"kwhash.h\"\n\n");
+
+	char *line = NULL;
+	size_t capacity = 0;
+	int lineno = 0;
+	while (getline(&line, &capacity, stdin) != -1) {
+		lineno++;
+		char *save = NULL;
+		char *first = strtok_r(line, " \t\n", &save);
+		if (!first || first[0] == '#') continue;
+
+		if (strcmp(first, "lang") == 0) {
+			char *name = strtok_r(NULL, " \t\n", &save);
+			if (!flush_lang()) return EXIT_FAILURE;
+			if (!name || strlen(name) >= sizeof(lang)) {
+				fprintf(stderr, "gen_keywords: line %d: bad lang\n", lineno);
+				return EXIT_FAILURE;
+			}
+			strcpy(lang, name);
+			continue;
+		}
+		if (!lang[0]) {
+			fprintf(stderr, "gen_keywords: line %d: words before lang\n",
+			        lineno);
+			return EXIT_FAILURE;
+		}
+
+		for (char *w; (w = strtok_r(NULL, " \t\n", &save));) {
+			for (int i = 0; i < nwords; i++) {
+				if (strcmp(words[i].word, w) == 0) {
+					fprintf(stderr, "gen_keywords: line %d: ", lineno);
+					fprintf(stderr, "'%s' twice in '%s'\n", w, lang);
+					return EXIT_FAILURE;
+				}
+			}
+			if (nwords == MAX_WORDS || strlen(w) > 255) {
+				fprintf(stderr, "gen_keywords: line %d: too many words\n",
+				        lineno);
+				return EXIT_FAILURE;
+			}
+			words[nwords].word = strdup(w);
+			words[nwords].token = strdup(first);
+			nwords++;
+		}
+	}
+	free(line);
+	return flush_lang() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
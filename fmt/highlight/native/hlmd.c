@@ -0,0 +1,472 @@
+#define _POSIX_C_SOURCE 200809L
+#include "hlmd.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "scan.h"
+
+// --- ANSI Escape Codes (same values as hlmd-st.py) ---
+#define RESET "\033[0m"
+#define BOLD "\033[1m"
+#define ITALIC "\033[3m"
+#define HEADER_COLOR "\033[94m"  // Blue
+#define BOLD_COLOR "\033[93m"    // Yellow
+#define ITALIC_COLOR "\033[92m"  // Green
+#define CODE_COLOR "\033[95m"    // Magenta
+
+#define HR_GLYPH "\xe2\x94\x80"  // U+2500 BOX DRAWINGS LIGHT HORIZONTAL
+
+// On/off sequences for each token class, exactly as Terminal256Formatter
+// emits them for MyAnsiStyle
+typedef struct {
+	const char *on;
+	const char *off;
+} sgr_pair;
+
+static const sgr_pair token_styles[HLMD_TOK_COUNT] = {
+    [HLMD_TOK_TEXT] = {"", ""},
+    [HLMD_TOK_COMMENT] = {"\033[90m", "\033[39m"},
+    [HLMD_TOK_KEYWORD] = {"\033[95m", "\033[39m"},
+    [HLMD_TOK_KEYWORD_CONSTANT] = {"\033[96m", "\033[39m"},
+    [HLMD_TOK_KEYWORD_DECLARATION] = {"\033[35m", "\033[39m"},
+    [HLMD_TOK_KEYWORD_NAMESPACE] = {"\033[94;01m", "\033[39;00m"},
+    [HLMD_TOK_KEYWORD_TYPE] = {"\033[36m", "\033[39m"},
+    [HLMD_TOK_NAME_BUILTIN] = {"\033[94m", "\033[39m"},
+    [HLMD_TOK_NAME_CLASS] = {"\033[92m", "\033[39m"},
+    [HLMD_TOK_NAME_FUNCTION] = {"\033[92m", "\033[39m"},
+    [HLMD_TOK_NAME_DECORATOR] = {"\033[95m", "\033[39m"},
+    [HLMD_TOK_NAME_TAG] = {"\033[35m", "\033[39m"},
+    [HLMD_TOK_NAME_ATTRIBUTE] = {"\033[33m", "\033[39m"},
+    [HLMD_TOK_NAME_VARIABLE] = {"\033[36m", "\033[39m"},
+    [HLMD_TOK_STRING] = {"\033[92m", "\033[39m"},
+    [HLMD_TOK_STRING_ESCAPE] = {"\033[33;01m", "\033[39;00m"},
+    [HLMD_TOK_STRING_DOC] = {"\033[90m", "\033[39m"},
+    [HLMD_TOK_NUMBER] = {"\033[91m", "\033[39m"},
+    [HLMD_TOK_NUMBER_FLOAT] = {"\033[31m", "\033[39m"},
+    [HLMD_TOK_OPERATOR] = {"\033[01;01m", "\033[39;00m"},
+    [HLMD_TOK_GENERIC_DELETED] = {"\033[31m", "\033[39m"},
+    [HLMD_TOK_GENERIC_INSERTED] = {"\033[92m", "\033[39m"},
+    [HLMD_TOK_GENERIC_HEADING] = {"\033[94;01m", "\033[39;00m"},
+    [HLMD_TOK_GENERIC_SUBHEADING] = {"\033[34;01m", "\033[39;00m"},
+    [HLMD_TOK_ERROR] = {"\033[01;41;01m", "\033[39;49;00m"},
+};
+
+static int is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+	       c == '\v';
+}
+
+// Python's \w, treating every non-ASCII byte as part of a word
+static int is_word(char c) {
+	unsigned char u = (unsigned char)c;
+	return u >= 0x80 || isalnum(u) || u == '_';
+}
+
+void hlmd_init(hlmd_state *st) {
+	st->in_code_block = 0;
+	st->code_language[0] = '\0';
+	st->lexer = NULL;
+	st->lex_state = 0;
+	st->hr_width = 0;
+	st->truncated = 0;
+}
+
+int hlmd_terminal_width(void) {
+	const char *columns = getenv("COLUMNS");
+	if (columns && atoi(columns) > 0) return atoi(columns);
+
+	struct winsize ws;
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) {
+		return ws.ws_col;
+	}
+	return 80;
+}
+
+int hlmd_emit_token(buffer_t *out, hlmd_token tok, const char *text,
+                    size_t len) {
+	const sgr_pair *style = &token_styles[tok];
+	return buffer_append_str(out, style->on) &&
+	       buffer_append(out, text, len) && buffer_append_str(out, style->off);
+}
+
+// --- Inline spans ---
+//
+// Bold, italic and inline code are resolved CommonMark-style in time linear
+// in the line length: one pass collects delimiter runs, code spans pair
+// backtick runs of equal length through a table of the next run of each
+// length, and emphasis is matched on a delimiter stack whose searches are
+// bounded by openers_bottom. Output is then written in a single pass.
+
+#define CODE_RUN_MAX 64  // Longer backtick runs never open a code span
+
+typedef struct {
+	size_t pos;    // First byte of the run
+	size_t len;    // Original run length
+	size_t count;  // Delimiters left unmatched
+	int prev;      // Neighbours on the delimiter stack, -1 at either end
+	int next;
+	int match;  // Backtick runs: index of the closing run, -1 if none
+	char c;     // '`', '*' or '_'
+	unsigned char can_open;
+	unsigned char can_close;
+} delim_run;
+
+// Marks on delimiter bytes that become styling instead of text
+enum {
+	MARK_TEXT,
+	MARK_BOLD_OPEN,  // Two bytes
+	MARK_BOLD_CLOSE,
+	MARK_ITALIC_OPEN,  // One byte
+	MARK_ITALIC_CLOSE,
+};
+
+static int is_punct(char c) {
+	unsigned char u = (unsigned char)c;
+	return u < 0x80 && ispunct(u);
+}
+
+// Flanking rules for a '*' or '_' run, with the line edges as whitespace
+static void classify_run(const char *s, size_t len, delim_run *r) {
+	char before = r->pos > 0 ? s[r->pos - 1] : ' ';
+	char after = r->pos + r->len < len ? s[r->pos + r->len] : ' ';
+	int left = !is_space(after) &&
+	           (!is_punct(after) || is_space(before) || is_punct(before));
+	int right = !is_space(before) &&
+	            (!is_punct(before) || is_space(after) || is_punct(after));
+	if (r->c == '*') {
+		r->can_open = left;
+		r->can_close = right;
+	} else {  // Intra-word underscores neither open nor close
+		r->can_open = left && (!right || is_punct(before));
+		r->can_close = right && (!left || is_punct(after));
+	}
+}
+
+// Pair each backtick run with the next run of the same length, left to
+// right, and link the '*'/'_' runs outside code spans into a stack
+// Returns the index of the bottom of the stack, -1 if it is empty
+static int resolve_code_spans(delim_run *runs, int nruns) {
+	int next_same[CODE_RUN_MAX];
+	for (int l = 0; l < CODE_RUN_MAX; l++) next_same[l] = -1;
+	for (int k = nruns - 1; k >= 0; k--) {
+		runs[k].match = -1;
+		if (runs[k].c != '`' || runs[k].len >= CODE_RUN_MAX) continue;
+		runs[k].match = next_same[runs[k].len];
+		next_same[runs[k].len] = k;
+	}
+
+	int bottom = -1;
+	int top = -1;
+	for (int k = 0; k < nruns; k++) {
+		if (runs[k].c == '`') {
+			if (runs[k].match >= 0) k = runs[k].match;  // Skip the span
+			continue;
+		}
+		runs[k].prev = top;
+		runs[k].next = -1;
+		if (top >= 0) {
+			runs[top].next = k;
+		} else {
+			bottom = k;
+		}
+		top = k;
+	}
+	return bottom;
+}
+
+static void unlink_run(delim_run *runs, int *bottom, int k) {
+	if (runs[k].prev >= 0) {
+		runs[runs[k].prev].next = runs[k].next;
+	} else {
+		*bottom = runs[k].next;
+	}
+	if (runs[k].next >= 0) runs[runs[k].next].prev = runs[k].prev;
+}
+
+// CommonMark's process_emphasis: match closers against the nearest
+// compatible opener and mark the delimiter bytes they consume
+static void resolve_emphasis(delim_run *runs, int bottom,
+                             unsigned char *marks) {
+	// Lowest opener worth searching, per [char][closer len % 3][can_open]
+	int openers_bottom[2][3][2];
+	for (int i = 0; i < 2 * 3 * 2; i++) (&openers_bottom[0][0][0])[i] = -1;
+
+	int k = bottom;
+	while (k >= 0) {
+		delim_run *closer = &runs[k];
+		if (!closer->can_close) {
+			k = closer->next;
+			continue;
+		}
+		int *floor = &openers_bottom[closer->c == '_'][closer->len % 3]
+		                            [closer->can_open];
+		int o = closer->prev;
+		for (; o >= 0 && o > *floor; o = runs[o].prev) {
+			delim_run *opener = &runs[o];
+			if (opener->c != closer->c || !opener->can_open) continue;
+			// Rule of three
+			if ((opener->can_close || closer->can_open) &&
+			    (opener->len + closer->len) % 3 == 0 &&
+			    (opener->len % 3 != 0 || closer->len % 3 != 0)) {
+				continue;
+			}
+			break;
+		}
+
+		if (o < 0 || o <= *floor) {
+			*floor = closer->prev;
+			int next = closer->next;
+			if (!closer->can_open) unlink_run(runs, &bottom, k);
+			k = next;
+			continue;
+		}
+
+		delim_run *opener = &runs[o];
+		size_t use = opener->count >= 2 && closer->count >= 2 ? 2 : 1;
+		opener->count -= use;
+		marks[opener->pos + opener->count] =
+		    use == 2 ? MARK_BOLD_OPEN : MARK_ITALIC_OPEN;
+		marks[closer->pos + closer->len - closer->count] =
+		    use == 2 ? MARK_BOLD_CLOSE : MARK_ITALIC_CLOSE;
+		closer->count -= use;
+
+		// Delimiters between the pair can no longer match anything
+		opener->next = k;
+		closer->prev = o;
+		if (opener->count == 0) unlink_run(runs, &bottom, o);
+		if (closer->count == 0) {
+			int next = closer->next;
+			unlink_run(runs, &bottom, k);
+			k = next;
+		}
+	}
+}
+
+// Styles still open in the output, so they can be restored after the RESET
+// that ends an inner span
+typedef struct {
+	const char *base;  // Style of the surrounding text, e.g. a header
+	unsigned char *spans;  // Open MARK_*_OPEN kinds, innermost last
+	size_t depth;
+	size_t bold;  // Open spans of each kind
+	size_t italic;
+} style_stack;
+
+static int restore_style(const style_stack *styles, buffer_t *out) {
+	if (!buffer_append_str(out, RESET) ||
+	    !buffer_append_str(out, styles->base)) {
+		return 0;
+	}
+	if (styles->bold && !buffer_append_str(out, BOLD)) return 0;
+	if (styles->italic && !buffer_append_str(out, ITALIC)) return 0;
+	if (styles->depth == 0) return 1;
+	return buffer_append_str(out,
+	                         styles->spans[styles->depth - 1] == MARK_BOLD_OPEN
+	                             ? BOLD_COLOR
+	                             : ITALIC_COLOR);
+}
+
+// Write the line with its resolved spans
+static int emit_spans(const char *s, size_t len, const delim_run *runs,
+                      int nruns, const unsigned char *marks,
+                      style_stack *styles, buffer_t *out) {
+	int run = 0;  // Next run that may start a code span
+	size_t plain = 0;
+	size_t i = 0;
+
+	while ((i = hlmd_scan_special(s, i, len)) < len) {
+		while (run < nruns && runs[run].pos < i) run++;
+		if (run < nruns && runs[run].pos == i && runs[run].c == '`') {
+			const delim_run *open = &runs[run];
+			if (open->match < 0) {
+				i += open->len;  // Literal backticks
+				continue;
+			}
+			const delim_run *close = &runs[open->match];
+			size_t inner = open->pos + open->len;
+			if (!buffer_append(out, s + plain, i - plain) ||
+			    !buffer_append_str(out, CODE_COLOR) ||
+			    !buffer_append(out, s + inner, close->pos - inner) ||
+			    !restore_style(styles, out)) {
+				return 0;
+			}
+			i = plain = close->pos + close->len;
+			continue;
+		}
+
+		unsigned char mark = marks[i];
+		if (mark == MARK_TEXT) {
+			i++;
+			continue;
+		}
+		if (!buffer_append(out, s + plain, i - plain)) return 0;
+		if (mark == MARK_BOLD_OPEN || mark == MARK_ITALIC_OPEN) {
+			int bold = mark == MARK_BOLD_OPEN;
+			styles->spans[styles->depth++] = mark;
+			bold ? styles->bold++ : styles->italic++;
+			if (!buffer_append_str(out, bold ? BOLD BOLD_COLOR
+			                                 : ITALIC ITALIC_COLOR)) {
+				return 0;
+			}
+		} else {
+			styles->depth--;
+			mark == MARK_BOLD_CLOSE ? styles->bold-- : styles->italic--;
+			if (!restore_style(styles, out)) return 0;
+		}
+		i += mark == MARK_BOLD_OPEN || mark == MARK_BOLD_CLOSE ? 2 : 1;
+		plain = i;
+	}
+	return buffer_append(out, s + plain, len - plain);
+}
+
+int hlmd_inline(const char *s, size_t len, const char *base, buffer_t *out) {
+	// Count delimiter runs; most prose lines have none and are copied as is
+	int nruns = 0;
+	for (size_t i = 0; (i = hlmd_scan_special(s, i, len)) < len;) {
+		char c = s[i++];
+		if (c != '`' && c != '*' && c != '_') continue;
+		while (i < len && s[i] == c) i++;
+		nruns++;
+	}
+	if (nruns == 0) return buffer_append(out, s, len);
+
+	// One block for the runs, the byte marks and the open-span stack
+	delim_run *runs = malloc(nruns * sizeof(delim_run) + 2 * len);
+	if (!runs) return 0;
+	unsigned char *marks = (unsigned char *)(runs + nruns);
+	style_stack styles = {.base = base ? base : "", .spans = marks + len};
+	memset(marks, MARK_TEXT, len);
+
+	int k = 0;
+	for (size_t i = 0; (i = hlmd_scan_special(s, i, len)) < len;) {
+		char c = s[i];
+		if (c != '`' && c != '*' && c != '_') {
+			i++;
+			continue;
+		}
+		delim_run *r = &runs[k++];
+		r->pos = i;
+		r->c = c;
+		while (i < len && s[i] == c) i++;
+		r->len = r->count = i - r->pos;
+		if (c != '`') classify_run(s, len, r);
+	}
+
+	int bottom = resolve_code_spans(runs, nruns);
+	resolve_emphasis(runs, bottom, marks);
+	int ok = emit_spans(s, len, runs, nruns, marks, &styles, out);
+	free(runs);
+	return ok;
+}
+
+// Match ^\s*```\s*(\w*)\s*$ and copy the language name
+static int match_fence(const char *line, size_t len, char *lang) {
+	size_t i = 0;
+	while (i < len && is_space(line[i])) i++;
+	if (len - i < 3 || memcmp(line + i, "```", 3) != 0) return 0;
+	i += 3;
+	while (i < len && is_space(line[i])) i++;
+
+	size_t start = i;
+	while (i < len && is_word(line[i]) && (unsigned char)line[i] < 0x80) i++;
+	size_t lang_len = i - start;
+
+	while (i < len && is_space(line[i])) i++;
+	if (i != len) return 0;
+
+	if (lang_len >= HLMD_LANG_MAX) lang_len = HLMD_LANG_MAX - 1;
+	memcpy(lang, line + start, lang_len);
+	lang[lang_len] = '\0';
+	return 1;
+}
+
+// Match ^[\s]*([-\*=_]){3,}[\s]*$
+static int match_hr(const char *line, size_t len) {
+	size_t i = 0;
+	while (i < len && is_space(line[i])) i++;
+	size_t marks = 0;
+	while (i < len && strchr("-*=_", line[i]) && line[i] != '\0') {
+		marks++;
+		i++;
+	}
+	while (i < len && is_space(line[i])) i++;
+	return marks >= 3 && i == len;
+}
+
+static int emit_code_line(hlmd_state *st, const char *line, size_t len,
+                          buffer_t *out) {
+	if (st->lexer) {
+		return hlmd_lex_line(st->lexer, &st->lex_state, line, len, out);
+	}
+	// Equivalent of the 'text' lexer fallback
+	if (!hlmd_emit_token(out, HLMD_TOK_TEXT, line, len)) return 0;
+	if (len == 0 || line[len - 1] != '\n') return buffer_append(out, "\n", 1);
+	return 1;
+}
+
+int hlmd_feed_line(hlmd_state *st, const char *line, size_t len,
+                   buffer_t *out) {
+	// --- Fenced Code Blocks ---
+	char lang[HLMD_LANG_MAX];
+	if (match_fence(line, len, lang)) {
+		if (st->in_code_block) {
+			st->in_code_block = 0;
+			st->code_language[0] = '\0';
+			st->lexer = NULL;
+			return buffer_append_str(out, RESET);
+		}
+		st->in_code_block = 1;
+		memcpy(st->code_language, lang, sizeof(lang));
+		st->lexer = hlmd_lexer_find(lang);
+		st->lex_state = 0;
+		return 1;  // Don't print the opening ``` line itself
+	}
+
+	if (st->in_code_block) return emit_code_line(st, line, len, out);
+
+	// Everything else works on the line without its newline
+	size_t text_len = len;
+	while (text_len > 0 && (line[text_len - 1] == '\n')) text_len--;
+
+	// --- Headers ---
+	size_t level = 0;
+	while (level < len && line[level] == '#') level++;
+	if (level > 0 && level < len && is_space(line[level])) {
+		size_t start = level;
+		while (start < text_len && is_space(line[start])) start++;
+		if (!buffer_append_str(out, BOLD HEADER_COLOR) ||
+		    !buffer_append(out, line, level) || !buffer_append(out, " ", 1) ||
+		    !hlmd_inline(line + start, text_len > start ? text_len - start : 0,
+		                 BOLD HEADER_COLOR, out)) {
+			return 0;
+		}
+		return buffer_append_str(out, RESET "\n");
+	}
+
+	// --- Horizontal Rules ---
+	if (match_hr(line, len)) {
+		int width = st->hr_width > 0 ? st->hr_width : hlmd_terminal_width();
+		if (!buffer_append_str(out, BOLD HEADER_COLOR)) return 0;
+		for (int i = 0; i < width; i++) {
+			if (!buffer_append_str(out, HR_GLYPH)) return 0;
+		}
+		return buffer_append_str(out, RESET "\n");
+	}
+
+	// --- Regular Text ---
+	while (text_len > 0 && is_space(line[text_len - 1])) text_len--;
+	return hlmd_inline(line, text_len, NULL, out) &&
+	       buffer_append(out, "\n", 1);
+}
+
+int hlmd_finish(hlmd_state *st, buffer_t *out) {
+	if (!st->in_code_block) return 1;
+	// Reset style if we were in a code block
+	st->in_code_block = 0;
+	st->truncated = 1;
+	return buffer_append_str(out, RESET);
+}
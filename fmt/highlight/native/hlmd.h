@@ -0,0 +1,84 @@
+#ifndef HLMD_H
+#define HLMD_H
+
+#include <stddef.h>  // For size_t
+
+#include "buffer.h"
+#include "lex.h"
+
+// Native streaming markdown highlighter
+//
+// Same constructs and colors as hlmd-st.py's process_line(): fenced code
+// blocks, ATX headers, horizontal rules, and bold/italic/inline code in
+// regular text. Input is fed one line at a time and the ANSI output for that
+// line is appended to a caller-owned buffer, so nothing is ever re-rendered.
+
+#define HLMD_LANG_MAX 32
+
+// Token classes a code lexer can produce. Colors follow MyAnsiStyle in
+// hlmd-st.py as rendered by Terminal256Formatter.
+typedef enum {
+	HLMD_TOK_TEXT,
+	HLMD_TOK_COMMENT,
+	HLMD_TOK_KEYWORD,
+	HLMD_TOK_KEYWORD_CONSTANT,
+	HLMD_TOK_KEYWORD_DECLARATION,
+	HLMD_TOK_KEYWORD_NAMESPACE,
+	HLMD_TOK_KEYWORD_TYPE,
+	HLMD_TOK_NAME_BUILTIN,
+	HLMD_TOK_NAME_CLASS,
+	HLMD_TOK_NAME_FUNCTION,
+	HLMD_TOK_NAME_DECORATOR,
+	HLMD_TOK_NAME_TAG,
+	HLMD_TOK_NAME_ATTRIBUTE,
+	HLMD_TOK_NAME_VARIABLE,
+	HLMD_TOK_STRING,
+	HLMD_TOK_STRING_ESCAPE,
+	HLMD_TOK_STRING_DOC,
+	HLMD_TOK_NUMBER,
+	HLMD_TOK_NUMBER_FLOAT,
+	HLMD_TOK_OPERATOR,
+	HLMD_TOK_GENERIC_DELETED,
+	HLMD_TOK_GENERIC_INSERTED,
+	HLMD_TOK_GENERIC_HEADING,
+	HLMD_TOK_GENERIC_SUBHEADING,
+	HLMD_TOK_ERROR,
+	HLMD_TOK_COUNT
+} hlmd_token;
+
+// Block-level tokenizer state carried from one line to the next
+typedef struct {
+	int in_code_block;
+	char code_language[HLMD_LANG_MAX];  // Empty if the fence named none
+	const hlmd_lexer *lexer;  // Native lexer for code_language, NULL if none
+	unsigned char lex_state;  // Carried from one code line to the next
+	int hr_width;  // Columns for horizontal rules, 0 = ask the terminal
+	int truncated;  // hlmd_finish() closed a code block that never ended
+} hlmd_state;
+
+// Initialize tokenizer state for a new document
+void hlmd_init(hlmd_state *st);
+
+// Render one input line (with or without its trailing '\n') into out
+// Returns 1 on success, 0 on allocation failure
+int hlmd_feed_line(hlmd_state *st, const char *line, size_t len,
+                   buffer_t *out);
+
+// Close any construct still open at end of input; a code block closed this
+// way sets st->truncated. Returns 1 on success, 0 on allocation failure
+int hlmd_finish(hlmd_state *st, buffer_t *out);
+
+// Render bold, italic and inline code spans in one line of text (without its
+// newline) into out, in time linear in len. base is the SGR sequence of the
+// surrounding text, restored after each span ends; NULL for none.
+// Returns 1 on success, 0 on allocation failure
+int hlmd_inline(const char *text, size_t len, const char *base, buffer_t *out);
+
+// Append a code token in its MyAnsiStyle color
+int hlmd_emit_token(buffer_t *out, hlmd_token tok, const char *text,
+                    size_t len);
+
+// Terminal width from $COLUMNS or the stdout tty, 80 if neither is known
+int hlmd_terminal_width(void);
+
+#endif
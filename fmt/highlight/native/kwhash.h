@@ -0,0 +1,44 @@
+#ifndef HLMD_KWHASH_H
+#define HLMD_KWHASH_H
+
+#include <stddef.h>  // For size_t
+#include <stdint.h>
+#include <string.h>
+
+// Perfect-hash keyword tables, generated at build time by gen_keywords from
+// keywords.def. The generator searches for a seed under which no two words
+// of a language share a slot, so a lookup is one hash and one compare.
+
+typedef struct {
+	const char *word;  // NULL for an empty slot
+	unsigned char len;
+	unsigned char token;  // hlmd_token
+} hlmd_keyword;
+
+typedef struct {
+	uint32_t seed;
+	uint32_t mask;  // Slot count - 1, a power of two
+	const hlmd_keyword *slots;
+} hlmd_keyword_table;
+
+// Seeded FNV-1a; gen_keywords uses the same function
+static inline uint32_t hlmd_kw_hash(const char *s, size_t len, uint32_t seed) {
+	uint32_t h = 2166136261u ^ seed;
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+	return h ^ (h >> 15);
+}
+
+// Token class of word s, or -1 if it isn't a keyword
+static inline int hlmd_kw_lookup(const hlmd_keyword_table *t, const char *s,
+                                 size_t len) {
+	const hlmd_keyword *k = &t->slots[hlmd_kw_hash(s, len, t->seed) & t->mask];
+	if (k->word && k->len == len && memcmp(k->word, s, len) == 0) {
+		return k->token;
+	}
+	return -1;
+}
+
+#endif
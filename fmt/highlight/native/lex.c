@@ -0,0 +1,443 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lex.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+#include "hlmd.h"
+#include "keywords.h"  // Generated by build from keywords.def
+#include "kwhash.h"
+
+// The construct a line left open, in the low bits of the state byte. The
+// upper bits hold the extra nesting depth of a Rust block comment.
+enum {
+	OPEN_NONE,
+	OPEN_COMMENT,     // /* ... */
+	OPEN_DQ,          // "..." where strings may span lines
+	OPEN_SQ,          // '...' in sh
+	OPEN_TRIPLE_DQ,   // """..."""
+	OPEN_TRIPLE_SQ,   // '''...'''
+	OPEN_BACKTICK,    // Go raw string
+};
+#define OPEN_KIND(state) ((state) & 0x0f)
+#define OPEN_DEPTH(state) ((state) >> 4)
+#define COMMENT_DEPTH_MAX 16
+
+// Language features switched on in the shared code lexer
+enum {
+	LEX_C_COMMENTS = 1 << 0,       // // and /* */
+	LEX_NESTED_COMMENTS = 1 << 1,  // /* /* */ */ (Rust)
+	LEX_PREPROC = 1 << 2,          // # directives (C, C++)
+	LEX_LIFETIMES = 1 << 3,        // 'a is a lifetime, not a char (Rust)
+	LEX_MULTILINE_DQ = 1 << 4,     // "..." may span lines (Rust, sh)
+	LEX_BACKTICK_RAW = 1 << 5,     // `...` raw strings (Go)
+	LEX_PYTHON = 1 << 6,  // # comments, triple quotes, prefixes, decorators
+	LEX_SHELL = 1 << 7,   // # at word start, $variables, raw '...'
+};
+
+typedef int (*lex_fn)(const hlmd_lexer *lx, unsigned char *state,
+                      const char *s, size_t n, buffer_t *out);
+
+struct hlmd_lexer {
+	const char *names;  // Space-separated fence names
+	lex_fn lex;         // Lexes one line without its '\n'
+	const hlmd_keyword_table *keywords;
+	unsigned flags;
+	const char *function_intro;  // Keywords naming a function next
+	const char *class_intro;     // Keywords naming a type next
+};
+
+static int is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static int is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static int is_ident_start(char c) {
+	unsigned char u = (unsigned char)c;
+	return u >= 0x80 || isalpha(u) || u == '_';
+}
+
+static int is_ident(char c) {
+	return is_ident_start(c) || isdigit((unsigned char)c);
+}
+
+static int only_space_before(const char *s, size_t i) {
+	while (i > 0 && is_space(s[i - 1])) i--;
+	return i == 0;
+}
+
+// Is s[0, len) one of the words in a space-separated list
+static int word_in(const char *list, const char *s, size_t len) {
+	if (!list) return 0;
+	for (const char *p = list; *p;) {
+		const char *end = strchr(p, ' ');
+		size_t word_len = end ? (size_t)(end - p) : strlen(p);
+		if (word_len == len && memcmp(p, s, len) == 0) return 1;
+		if (!end) break;
+		p = end + 1;
+	}
+	return 0;
+}
+
+// Emit s[start, end) as one token, if it isn't empty
+static int emit(buffer_t *out, hlmd_token tok, const char *s, size_t start,
+                size_t end) {
+	return end == start || hlmd_emit_token(out, tok, s + start, end - start);
+}
+
+// Lex a string body from s[*i] up to and including its closing quote; its
+// text from seg on is still unemitted. A string still open at the end of
+// the line sets *state if this kind of string may span lines.
+static int lex_string(unsigned char kind, int escapes, int multiline,
+                      unsigned char *state, const char *s, size_t n,
+                      size_t *i, size_t seg, buffer_t *out) {
+	const char *close = kind == OPEN_DQ          ? "\""
+	                    : kind == OPEN_SQ        ? "'"
+	                    : kind == OPEN_TRIPLE_DQ ? "\"\"\""
+	                    : kind == OPEN_TRIPLE_SQ ? "'''"
+	                                             : "`";
+	size_t close_len = strlen(close);
+
+	for (size_t p = *i; p < n;) {
+		if (escapes && s[p] == '\\') {
+			size_t end = p + 2 <= n ? p + 2 : n;
+			if (!emit(out, HLMD_TOK_STRING, s, seg, p) ||
+			    !emit(out, HLMD_TOK_STRING_ESCAPE, s, p, end)) {
+				return 0;
+			}
+			p = seg = end;
+			continue;
+		}
+		if (p + close_len <= n && memcmp(s + p, close, close_len) == 0) {
+			*state = OPEN_NONE;
+			*i = p + close_len;
+			return emit(out, HLMD_TOK_STRING, s, seg, *i);
+		}
+		p++;
+	}
+	*state = multiline ? kind : OPEN_NONE;
+	*i = n;
+	return emit(out, HLMD_TOK_STRING, s, seg, n);
+}
+
+static int string_escapes(const hlmd_lexer *lx, unsigned char kind) {
+	if (kind == OPEN_BACKTICK) return 0;
+	return !(kind == OPEN_SQ && (lx->flags & LEX_SHELL));
+}
+
+static int string_multiline(const hlmd_lexer *lx, unsigned char kind) {
+	switch (kind) {
+	case OPEN_DQ:
+		return (lx->flags & LEX_MULTILINE_DQ) != 0;
+	case OPEN_SQ:
+		return (lx->flags & LEX_SHELL) != 0;
+	default:
+		return 1;
+	}
+}
+
+// Lex a string whose opening quote is at s[*i]
+static int lex_quote(const hlmd_lexer *lx, unsigned char *state,
+                     const char *s, size_t n, size_t *i, size_t seg,
+                     buffer_t *out) {
+	char q = s[*i];
+	unsigned char kind;
+	if ((lx->flags & LEX_PYTHON) && *i + 2 < n && s[*i + 1] == q &&
+	    s[*i + 2] == q) {
+		kind = q == '"' ? OPEN_TRIPLE_DQ : OPEN_TRIPLE_SQ;
+		*i += 3;
+	} else {
+		kind = q == '"' ? OPEN_DQ : q == '\'' ? OPEN_SQ : OPEN_BACKTICK;
+		*i += 1;
+	}
+	int escapes = string_escapes(lx, kind);
+	int multiline = string_multiline(lx, kind);
+	return lex_string(kind, escapes, multiline, state, s, n, i, seg, out);
+}
+
+// Lex a block comment from s[*i] to its close; its text from seg on is
+// still unemitted and depth comments are open
+static int lex_block_comment(const hlmd_lexer *lx, unsigned char *state,
+                             const char *s, size_t n, size_t *i, size_t seg,
+                             unsigned depth, buffer_t *out) {
+	for (size_t p = *i; p + 1 < n;) {
+		if (s[p] == '*' && s[p + 1] == '/') {
+			p += 2;
+			if (--depth == 0) {
+				*state = OPEN_NONE;
+				*i = p;
+				return emit(out, HLMD_TOK_COMMENT, s, seg, p);
+			}
+		} else if ((lx->flags & LEX_NESTED_COMMENTS) && s[p] == '/' &&
+		           s[p + 1] == '*') {
+			p += 2;
+			if (depth < COMMENT_DEPTH_MAX) depth++;
+		} else {
+			p++;
+		}
+	}
+	*state = OPEN_COMMENT | (depth - 1) << 4;
+	*i = n;
+	return emit(out, HLMD_TOK_COMMENT, s, seg, n);
+}
+
+// Continue a construct left open by the previous line
+static int lex_resume(const hlmd_lexer *lx, unsigned char *state,
+                      const char *s, size_t n, size_t *i, buffer_t *out) {
+	unsigned char kind = OPEN_KIND(*state);
+	if (kind == OPEN_NONE) return 1;
+	if (kind == OPEN_COMMENT) {
+		return lex_block_comment(lx, state, s, n, i, 0, OPEN_DEPTH(*state) + 1,
+		                         out);
+	}
+	return lex_string(kind, string_escapes(lx, kind), 1, state, s, n, i, 0,
+	                  out);
+}
+
+// Decimal, hex/octal/binary, and float literals with any type suffix
+static size_t lex_number(const char *s, size_t n, size_t i, int *is_float) {
+	*is_float = 0;
+	if (s[i] == '0' && i + 1 < n && strchr("xXoObB", s[i + 1]) &&
+	    s[i + 1] != '\0') {
+		i += 2;
+		while (i < n && (isalnum((unsigned char)s[i]) || s[i] == '_')) i++;
+		return i;
+	}
+	while (i < n && (isdigit((unsigned char)s[i]) || s[i] == '_')) i++;
+	if (i + 1 < n && s[i] == '.' && isdigit((unsigned char)s[i + 1])) {
+		*is_float = 1;
+		i++;
+		while (i < n && (isdigit((unsigned char)s[i]) || s[i] == '_')) i++;
+	}
+	if (i < n && (s[i] == 'e' || s[i] == 'E')) {
+		size_t j = i + 1;
+		if (j < n && (s[j] == '+' || s[j] == '-')) j++;
+		if (j < n && isdigit((unsigned char)s[j])) {
+			*is_float = 1;
+			i = j;
+			while (i < n && isdigit((unsigned char)s[i])) i++;
+		}
+	}
+	while (i < n && is_ident(s[i])) i++;  // 10u, 1.5f, 3i64
+	return i;
+}
+
+// Python's r"", b"", f"", rb"", ... prefixes
+static int is_string_prefix(const char *s, size_t len) {
+	if (len == 0 || len > 2) return 0;
+	for (size_t i = 0; i < len; i++) {
+		if (!strchr("rRbBfFuU", s[i]) || s[i] == '\0') return 0;
+	}
+	return 1;
+}
+
+// Rust: is the quote at s[i] a char literal ('a', '\n', 'é') rather than a
+// lifetime ('a)
+static int is_char_literal(const char *s, size_t n, size_t i) {
+	size_t j = i + 1;
+	if (j < n && s[j] == '\\') return 1;
+	if (j >= n) return 0;
+	j++;
+	while (j < n && ((unsigned char)s[j] & 0xc0) == 0x80) j++;
+	return j < n && s[j] == '\'';
+}
+
+// Shared lexer for the C family, Python and sh
+static int lex_code(const hlmd_lexer *lx, unsigned char *state,
+                    const char *s, size_t n, buffer_t *out) {
+	size_t i = 0;
+	if (!lex_resume(lx, state, s, n, &i, out)) return 0;
+
+	int expect = -1;  // Token for the next name after fn, class, ...
+	while (i < n) {
+		size_t start = i;
+		char c = s[i];
+		int tok = HLMD_TOK_TEXT;
+
+		if (is_space(c)) {
+			while (i < n && is_space(s[i])) i++;
+			if (!emit(out, HLMD_TOK_TEXT, s, start, i)) return 0;
+			continue;
+		}
+
+		int line_comment =
+		    ((lx->flags & LEX_C_COMMENTS) && c == '/' && i + 1 < n &&
+		     s[i + 1] == '/') ||
+		    ((lx->flags & LEX_PYTHON) && c == '#') ||
+		    ((lx->flags & LEX_SHELL) && c == '#' &&
+		     (i == 0 || is_space(s[i - 1])));
+		int directive = (lx->flags & LEX_PREPROC) && c == '#' &&
+		                only_space_before(s, i);
+		if (line_comment || directive) {
+			return emit(out, HLMD_TOK_COMMENT, s, start, n);
+		}
+		if ((lx->flags & LEX_C_COMMENTS) && c == '/' && i + 1 < n &&
+		    s[i + 1] == '*') {
+			i += 2;
+			if (!lex_block_comment(lx, state, s, n, &i, start, 1, out)) {
+				return 0;
+			}
+			continue;
+		}
+
+		expect = is_ident_start(c) ? expect : -1;
+		if (c == '\'' && (lx->flags & LEX_LIFETIMES) &&
+		    !is_char_literal(s, n, i)) {
+			i++;
+			while (i < n && is_ident(s[i])) i++;
+			tok = HLMD_TOK_NAME_ATTRIBUTE;
+		} else if (c == '"' || c == '\'' ||
+		           (c == '`' && (lx->flags & LEX_BACKTICK_RAW))) {
+			if (!lex_quote(lx, state, s, n, &i, start, out)) return 0;
+			continue;
+		} else if (isdigit((unsigned char)c) ||
+		           (c == '.' && i + 1 < n && is_digit(s[i + 1]))) {
+			int is_float;
+			i = lex_number(s, n, i, &is_float);
+			tok = is_float ? HLMD_TOK_NUMBER_FLOAT : HLMD_TOK_NUMBER;
+		} else if ((lx->flags & LEX_PYTHON) && c == '@' && i + 1 < n &&
+		           is_ident_start(s[i + 1])) {
+			i++;
+			while (i < n && (is_ident(s[i]) || s[i] == '.')) i++;
+			tok = HLMD_TOK_NAME_DECORATOR;
+		} else if ((lx->flags & LEX_SHELL) && c == '$' && i + 1 < n) {
+			i++;
+			if (s[i] == '{') {
+				while (i < n && s[i] != '}') i++;
+				if (i < n) i++;
+			} else if (is_ident_start(s[i])) {
+				while (i < n && is_ident(s[i])) i++;
+			} else if (is_digit(s[i]) || strchr("@*#?$!-", s[i])) {
+				i++;
+			}
+			tok = HLMD_TOK_NAME_VARIABLE;
+		} else if (is_ident_start(c)) {
+			while (i < n && is_ident(s[i])) i++;
+			if ((lx->flags & LEX_PYTHON) && i < n &&
+			    (s[i] == '"' || s[i] == '\'') &&
+			    is_string_prefix(s + start, i - start)) {
+				if (!lex_quote(lx, state, s, n, &i, start, out)) return 0;
+				continue;
+			}
+			tok = hlmd_kw_lookup(lx->keywords, s + start, i - start);
+			if (tok >= 0) {
+				expect = word_in(lx->function_intro, s + start, i - start)
+				             ? HLMD_TOK_NAME_FUNCTION
+				         : word_in(lx->class_intro, s + start, i - start)
+				             ? HLMD_TOK_NAME_CLASS
+				             : -1;
+			} else {
+				tok = expect >= 0 ? expect : HLMD_TOK_TEXT;
+				expect = -1;
+			}
+		} else if (strchr("+-*/%=<>!&|^~", c) && c != '\0') {
+			while (i < n && strchr("+-*/%=<>!&|^~", s[i]) && s[i] != '\0') i++;
+			tok = HLMD_TOK_OPERATOR;
+		} else {
+			i++;  // Punctuation
+		}
+		if (!emit(out, tok, s, start, i)) return 0;
+	}
+	return 1;
+}
+
+static int lex_json(const hlmd_lexer *lx, unsigned char *state,
+                    const char *s, size_t n, buffer_t *out) {
+	(void)state;
+	for (size_t i = 0; i < n;) {
+		size_t start = i;
+		char c = s[i];
+		int tok = HLMD_TOK_TEXT;
+
+		if (c == '"') {
+			i++;
+			while (i < n && s[i] != '"') i += s[i] == '\\' && i + 1 < n ? 2 : 1;
+			if (i < n) i++;
+			// A string followed by ':' is an object key
+			size_t next = i;
+			while (next < n && is_space(s[next])) next++;
+			tok = next < n && s[next] == ':' ? HLMD_TOK_NAME_TAG
+			                                 : HLMD_TOK_STRING;
+		} else if (is_digit(c) ||
+		           (c == '-' && i + 1 < n && is_digit(s[i + 1]))) {
+			int is_float;
+			i = lex_number(s, n, c == '-' ? i + 1 : i, &is_float);
+			tok = is_float ? HLMD_TOK_NUMBER_FLOAT : HLMD_TOK_NUMBER;
+		} else if (is_ident_start(c)) {
+			while (i < n && is_ident(s[i])) i++;
+			tok = hlmd_kw_lookup(lx->keywords, s + start, i - start);
+			if (tok < 0) tok = HLMD_TOK_TEXT;
+		} else if (is_space(c)) {
+			while (i < n && is_space(s[i])) i++;
+		} else {
+			i++;
+		}
+		if (!emit(out, tok, s, start, i)) return 0;
+	}
+	return 1;
+}
+
+// Whole-line classes, in the order Pygments' DiffLexer tries them
+static int lex_diff(const hlmd_lexer *lx, unsigned char *state,
+                    const char *s, size_t n, buffer_t *out) {
+	(void)lx;
+	(void)state;
+	int tok = HLMD_TOK_TEXT;
+	if (n == 0 || s[0] == ' ' || s[0] == '!' ||
+	    (n == 3 && memcmp(s, "---", 3) == 0)) {
+		tok = HLMD_TOK_TEXT;
+	} else if (s[0] == '-' || (n > 1 && s[0] == '<' && s[1] == ' ')) {
+		tok = HLMD_TOK_GENERIC_DELETED;
+	} else if (s[0] == '+' || (n > 1 && s[0] == '>' && s[1] == ' ')) {
+		tok = HLMD_TOK_GENERIC_INSERTED;
+	} else if (s[0] == '@') {
+		tok = HLMD_TOK_GENERIC_SUBHEADING;
+	} else if (s[0] == '=' || (n >= 5 && (memcmp(s, "Index", 5) == 0 ||
+	                                      memcmp(s, "index", 5) == 0)) ||
+	           (n >= 4 && memcmp(s, "diff", 4) == 0)) {
+		tok = HLMD_TOK_GENERIC_HEADING;
+	}
+	return emit(out, tok, s, 0, n);
+}
+
+static const hlmd_lexer lexers[] = {
+    {"c h", lex_code, &kw_c, LEX_C_COMMENTS | LEX_PREPROC, NULL,
+     "struct union enum"},
+    {"cpp c++ cc cxx hpp hh hxx", lex_code, &kw_cpp,
+     LEX_C_COMMENTS | LEX_PREPROC, NULL, "class struct union enum namespace"},
+    {"rust rs", lex_code, &kw_rust,
+     LEX_C_COMMENTS | LEX_NESTED_COMMENTS | LEX_LIFETIMES | LEX_MULTILINE_DQ,
+     "fn", "struct enum trait type union"},
+    {"go golang", lex_code, &kw_go, LEX_C_COMMENTS | LEX_BACKTICK_RAW, "func",
+     "type"},
+    {"python py python3 py3", lex_code, &kw_python, LEX_PYTHON, "def",
+     "class"},
+    {"sh bash shell zsh ksh", lex_code, &kw_sh, LEX_SHELL | LEX_MULTILINE_DQ,
+     "function", NULL},
+    {"json", lex_json, &kw_json, 0, NULL, NULL},
+    {"diff patch udiff", lex_diff, NULL, 0, NULL, NULL},
+};
+
+const hlmd_lexer *hlmd_lexer_find(const char *name) {
+	size_t len = strlen(name);
+	if (len == 0) return NULL;
+	for (size_t k = 0; k < sizeof(lexers) / sizeof(lexers[0]); k++) {
+		for (const char *p = lexers[k].names; *p;) {
+			size_t alias_len = strcspn(p, " ");
+			if (alias_len == len && strncasecmp(p, name, len) == 0) {
+				return &lexers[k];
+			}
+			p += alias_len;
+			if (*p == ' ') p++;
+		}
+	}
+	return NULL;
+}
+
+int hlmd_lex_line(const hlmd_lexer *lx, unsigned char *state,
+                  const char *line, size_t len, buffer_t *out) {
+	if (len > 0 && line[len - 1] == '\n') len--;
+	return lx->lex(lx, state, line, len, out) && buffer_append(out, "\n", 1);
+}
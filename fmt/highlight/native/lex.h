@@ -0,0 +1,26 @@
+#ifndef HLMD_LEX_H
+#define HLMD_LEX_H
+
+#include <stddef.h>  // For size_t
+
+#include "buffer.h"
+
+// Native code-fence lexers: C, C++, Rust, Go, Python, sh, JSON and diff
+//
+// A lexer highlights one line at a time. Whatever it needs to carry into
+// the next line (inside a block comment, a triple-quoted string, ...) fits
+// in one byte of state, so a fence can be resumed from any line.
+
+typedef struct hlmd_lexer hlmd_lexer;
+
+// Lexer for a fence's language name or one of its aliases, NULL if there is
+// no native lexer for it
+const hlmd_lexer *hlmd_lexer_find(const char *name);
+
+// Highlight one line (with or without its trailing '\n') into out, always
+// ending it with '\n'. *state is 0 at the start of a block and is updated
+// for the next line. Returns 1 on success, 0 on allocation failure
+int hlmd_lex_line(const hlmd_lexer *lx, unsigned char *state,
+                  const char *line, size_t len, buffer_t *out);
+
+#endif
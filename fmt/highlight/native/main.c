@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ring.h"
+#include "stream.h"
+
+// Write all of len bytes to fd, retrying partial writes
+// Returns 1 on success, 0 on failure
+static int write_all(int fd, const char *data, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return 0;
+		}
+		data += n;
+		len -= n;
+	}
+	return 1;
+}
+
+// Write out everything the stream has rendered so far
+// Returns 1 on success, 0 on failure
+static int drain_all(hlmd_stream *s, char *out, size_t size) {
+	size_t n;
+	while ((n = hlmd_stream_drain(s, out, size)) > 0) {
+		if (!write_all(STDOUT_FILENO, out, n)) return 0;
+	}
+	return 1;
+}
+
+// Exit status after stdout could not be written: it going away (e.g. piped
+// into head) only ends the stream early, anything else is an error
+static int write_failed(void) {
+	if (errno == EPIPE) return EXIT_SUCCESS;
+	perror("hlmd: error writing stdout");
+	return EXIT_FAILURE;
+}
+
+// Reader thread: stdin into the ring until EOF, straight into its free space
+static void *read_input(void *arg) {
+	hlmd_ring *ring = arg;
+	int failed = 0;
+	for (;;) {
+		char *at;
+		size_t space = hlmd_ring_space(ring, &at);
+		ssize_t n = read(STDIN_FILENO, at, space);
+		if (n == 0) break;
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			perror("hlmd: error reading stdin");
+			failed = 1;
+			break;
+		}
+		hlmd_ring_publish(ring, n);
+	}
+	hlmd_ring_close(ring, failed);
+	return NULL;
+}
+
+// hlmd: native drop-in for hlmd-st. Markdown stream on stdin, ANSI on stdout.
+//
+// Built on the same stream API that libhlmd.so exports (stream.h). stdin is
+// read on its own thread into a ring (ring.h), so the writer upstream is
+// never held up by a render or a slow terminal, only by a full ring. This
+// thread renders whatever has piled up since the last time, and all lines
+// that completed go out in one write.
+int main(void) {
+	// stdout going away must end the stream, not kill us: see write_failed()
+	signal(SIGPIPE, SIG_IGN);
+
+	hlmd_stream *s = hlmd_stream_new(0);
+	hlmd_ring ring;
+	if (!s || !hlmd_ring_init(&ring)) {
+		fprintf(stderr, "hlmd: out of memory\n");
+		return EXIT_FAILURE;
+	}
+	pthread_t reader;
+	int err = pthread_create(&reader, NULL, read_input, &ring);
+	if (err) {
+		fprintf(stderr, "hlmd: can't start reader thread: %s\n",
+		        strerror(err));
+		return EXIT_FAILURE;
+	}
+
+	// The reader may be blocked in read() for good: only an orderly end
+	// waits for it, the early returns stop it by exiting
+	static char out[65536];
+	const char *in;
+	size_t n;
+	while ((n = hlmd_ring_peek(&ring, &in)) > 0) {
+		int fed = hlmd_stream_feed(s, in, n);
+		hlmd_ring_consume(&ring, n);
+		if (!fed) {
+			fprintf(stderr, "hlmd: out of memory\n");
+			return EXIT_FAILURE;
+		}
+		if (!drain_all(s, out, sizeof(out))) return write_failed();
+	}
+
+	if (!hlmd_stream_finish(s)) {
+		fprintf(stderr, "hlmd: out of memory\n");
+		return EXIT_FAILURE;
+	}
+	if (hlmd_stream_truncated(s)) {
+		fprintf(stderr, "\n--- Code block potentially truncated ---\033[0m\n");
+	}
+	if (!drain_all(s, out, sizeof(out))) return write_failed();
+	pthread_join(reader, NULL);
+	int failed = hlmd_ring_failed(&ring);
+	hlmd_ring_free(&ring);
+	hlmd_stream_free(s);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+#include "ring.h"
+
+#include <stdlib.h>
+
+int hlmd_ring_init(hlmd_ring *r) {
+	r->data = malloc(HLMD_RING_SIZE);
+	if (!r->data) return 0;
+	atomic_init(&r->head, 0);
+	atomic_init(&r->tail, 0);
+	atomic_init(&r->closed, 0);
+	atomic_init(&r->failed, 0);
+	atomic_init(&r->waiting, 0);
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->wake, NULL);
+	return 1;
+}
+
+void hlmd_ring_free(hlmd_ring *r) {
+	pthread_mutex_destroy(&r->lock);
+	pthread_cond_destroy(&r->wake);
+	free(r->data);
+}
+
+// Wake the other side if it is asleep. A sleeper counts itself in waiting
+// before it checks the counters one last time, and the counter was moved
+// before this check, so either it sees the new counter or we see it.
+static void wake(hlmd_ring *r) {
+	if (atomic_load(&r->waiting) == 0) return;
+	pthread_mutex_lock(&r->lock);
+	pthread_cond_broadcast(&r->wake);
+	pthread_mutex_unlock(&r->lock);
+}
+
+size_t hlmd_ring_space(hlmd_ring *r, char **at) {
+	size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	size_t used = tail - atomic_load(&r->head);
+	if (used == HLMD_RING_SIZE) {
+		pthread_mutex_lock(&r->lock);
+		atomic_fetch_add(&r->waiting, 1);
+		while ((used = tail - atomic_load(&r->head)) == HLMD_RING_SIZE) {
+			pthread_cond_wait(&r->wake, &r->lock);
+		}
+		atomic_fetch_sub(&r->waiting, 1);
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	size_t off = tail & (HLMD_RING_SIZE - 1);
+	size_t space = HLMD_RING_SIZE - used;
+	*at = r->data + off;
+	return space < HLMD_RING_SIZE - off ? space : HLMD_RING_SIZE - off;
+}
+
+void hlmd_ring_publish(hlmd_ring *r, size_t len) {
+	atomic_fetch_add(&r->tail, len);
+	wake(r);
+}
+
+void hlmd_ring_close(hlmd_ring *r, int failed) {
+	atomic_store(&r->failed, failed);
+	atomic_store(&r->closed, 1);
+	wake(r);
+}
+
+size_t hlmd_ring_peek(hlmd_ring *r, const char **at) {
+	size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	size_t avail = atomic_load(&r->tail) - head;
+	if (avail == 0) {
+		pthread_mutex_lock(&r->lock);
+		atomic_fetch_add(&r->waiting, 1);
+		while ((avail = atomic_load(&r->tail) - head) == 0) {
+			if (atomic_load(&r->closed)) {
+				// Closed after its last publish, which may be newer than
+				// the tail just loaded
+				avail = atomic_load(&r->tail) - head;
+				break;
+			}
+			pthread_cond_wait(&r->wake, &r->lock);
+		}
+		atomic_fetch_sub(&r->waiting, 1);
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	size_t off = head & (HLMD_RING_SIZE - 1);
+	*at = r->data + off;
+	return avail < HLMD_RING_SIZE - off ? avail : HLMD_RING_SIZE - off;
+}
+
+void hlmd_ring_consume(hlmd_ring *r, size_t len) {
+	atomic_fetch_add(&r->head, len);
+	wake(r);
+}
+
+int hlmd_ring_failed(hlmd_ring *r) { return atomic_load(&r->failed); }
@@ -0,0 +1,55 @@
+#ifndef HLMD_RING_H
+#define HLMD_RING_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>  // For size_t
+
+// Single-producer, single-consumer byte ring between the thread reading
+// stdin and the one rendering
+//
+// The producer writes into the free space and publishes it by moving tail;
+// the consumer reads what is published and frees it by moving head. Both
+// are plain atomic counters, so bytes go through without locks. The mutex
+// and condition variable are only for sleeping: a side that finds the ring
+// empty (or full) waits until the other one has moved its counter.
+
+#define HLMD_RING_SIZE (1 << 20)  // Power of two
+
+typedef struct {
+	char *data;
+	atomic_size_t head;  // Bytes consumed, only moved by the consumer
+	atomic_size_t tail;  // Bytes published, only moved by the producer
+	atomic_int closed;   // The producer is done: EOF or a read error
+	atomic_int failed;   // ...and it was a read error
+	atomic_int waiting;  // A side is asleep, or about to be
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+} hlmd_ring;
+
+// Returns 1 on success, 0 on allocation failure
+int hlmd_ring_init(hlmd_ring *r);
+
+void hlmd_ring_free(hlmd_ring *r);
+
+// Producer: contiguous free space to write into, waiting while there is
+// none. Returns its length
+size_t hlmd_ring_space(hlmd_ring *r, char **at);
+
+// Producer: make len bytes written at hlmd_ring_space() visible
+void hlmd_ring_publish(hlmd_ring *r, size_t len);
+
+// Producer: no more input is coming, failed if it stopped on an error
+void hlmd_ring_close(hlmd_ring *r, int failed);
+
+// Consumer: contiguous published bytes, waiting while there are none
+// Returns their length, 0 once the ring is closed and empty
+size_t hlmd_ring_peek(hlmd_ring *r, const char **at);
+
+// Consumer: free len bytes returned by hlmd_ring_peek()
+void hlmd_ring_consume(hlmd_ring *r, size_t len);
+
+// Nonzero if the producer closed the ring on an error
+int hlmd_ring_failed(hlmd_ring *r);
+
+#endif
@@ -0,0 +1,107 @@
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HLMD_SCAN_X86
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HLMD_SCAN_NEON
+#endif
+
+const unsigned char hlmd_special[256] = {
+    ['`'] = 1, ['*'] = 1, ['_'] = 1, ['#'] = 1, ['\n'] = 1, ['\033'] = 1,
+};
+
+static size_t scan_scalar(const char *s, size_t start, size_t len) {
+	while (start < len && !hlmd_special[(unsigned char)s[start]]) start++;
+	return start;
+}
+
+#ifdef HLMD_SCAN_X86
+// One compare per special byte, OR'd into a mask of matching lanes
+#define SPECIAL_MASK(set1, cmpeq, vor, v)                                  \
+	vor(vor(vor(cmpeq(v, set1('`')), cmpeq(v, set1('*'))),                  \
+	        vor(cmpeq(v, set1('_')), cmpeq(v, set1('#')))),                 \
+	    vor(cmpeq(v, set1('\n')), cmpeq(v, set1('\033'))))
+
+__attribute__((target("sse2"))) static size_t scan_sse2(const char *s,
+                                                         size_t start,
+                                                         size_t len) {
+	while (start + 16 <= len) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + start));
+		__m128i hit =
+		    SPECIAL_MASK(_mm_set1_epi8, _mm_cmpeq_epi8, _mm_or_si128, v);
+		unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+		if (mask) return start + __builtin_ctz(mask);
+		start += 16;
+	}
+	return scan_scalar(s, start, len);
+}
+
+__attribute__((target("avx2"))) static size_t scan_avx2(const char *s,
+                                                         size_t start,
+                                                         size_t len) {
+	while (start + 32 <= len) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + start));
+		__m256i hit = SPECIAL_MASK(_mm256_set1_epi8, _mm256_cmpeq_epi8,
+		                           _mm256_or_si256, v);
+		unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+		if (mask) return start + __builtin_ctz(mask);
+		start += 32;
+	}
+	return scan_sse2(s, start, len);
+}
+#endif
+
+#ifdef HLMD_SCAN_NEON
+static size_t scan_neon(const char *s, size_t start, size_t len) {
+	while (start + 16 <= len) {
+		uint8x16_t v = vld1q_u8((const uint8_t *)(s + start));
+		uint8x16_t hit =
+		    vorrq_u8(vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8('`')),
+		                               vceqq_u8(v, vdupq_n_u8('*'))),
+		                      vorrq_u8(vceqq_u8(v, vdupq_n_u8('_')),
+		                               vceqq_u8(v, vdupq_n_u8('#')))),
+		             vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')),
+		                      vceqq_u8(v, vdupq_n_u8('\033'))));
+		// Narrow each lane to 4 bits: a 64-bit mask, 4 bits per byte
+		uint64_t mask = vget_lane_u64(
+		    vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+		if (mask) return start + (__builtin_ctzll(mask) >> 2);
+		start += 16;
+	}
+	return scan_scalar(s, start, len);
+}
+#endif
+
+typedef size_t (*scan_fn)(const char *s, size_t start, size_t len);
+
+// Set once by scan_select() before main() runs, or when libhlmd.so is
+// loaded, so threads only ever read them. Scalar until then.
+static scan_fn scan_impl = scan_scalar;
+static const char *scan_name = "scalar";
+
+// Pick the widest kernel this CPU runs
+__attribute__((constructor)) static void scan_select(void) {
+#if defined(HLMD_SCAN_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		scan_name = "avx2";
+		scan_impl = scan_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		scan_name = "sse2";
+		scan_impl = scan_sse2;
+	}
+#elif defined(HLMD_SCAN_NEON)
+	scan_name = "neon";
+	scan_impl = scan_neon;
+#endif
+}
+
+size_t hlmd_scan_special(const char *s, size_t start, size_t len) {
+	// Short runs aren't worth a vector load
+	if (start + 16 > len) return scan_scalar(s, start, len);
+	return scan_impl(s, start, len);
+}
+
+const char *hlmd_scan_kernel(void) { return scan_name; }
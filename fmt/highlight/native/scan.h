@@ -0,0 +1,23 @@
+#ifndef HLMD_SCAN_H
+#define HLMD_SCAN_H
+
+#include <stddef.h>  // For size_t
+
+// Byte-class scanning for the tokenizer's hot loop
+//
+// Most of a stream is prose that no markdown rule cares about. These find
+// the next markdown-significant byte ('`', '*', '_', '#', '\n', ESC) 16 or 32
+// bytes at a time with SSE2/AVX2 on x86 or NEON on ARM, picked at runtime,
+// with a scalar fallback everywhere else.
+
+// Nonzero for the bytes hlmd_scan_special() stops at
+extern const unsigned char hlmd_special[256];
+
+// Offset of the first special byte in s[start, len), or len if none
+size_t hlmd_scan_special(const char *s, size_t start, size_t len);
+
+// Name of the kernel hlmd_scan_special() dispatches to ("avx2", "sse2",
+// "neon" or "scalar")
+const char *hlmd_scan_kernel(void);
+
+#endif
@@ -0,0 +1,289 @@
+#include "sgr.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define ESC '\033'
+
+// Color kinds, in the top byte of hlmd_sgr_attrs.fg/bg
+#define SGR_COLOR_BASIC (1u << 24)    // 30-37/90-97 (40-47/100-107 for bg)
+#define SGR_COLOR_INDEXED (2u << 24)  // 38;5;n
+#define SGR_COLOR_RGB (3u << 24)      // 38;2;r;g;b
+#define SGR_COLOR_KIND(c) ((c) & 0xff000000u)
+#define SGR_COLOR_VALUE(c) ((c) & 0x00ffffffu)
+
+void hlmd_sgr_init(hlmd_sgr *st) {
+	memset(st, 0, sizeof(*st));
+}
+
+static int attrs_equal(const hlmd_sgr_attrs *a, const hlmd_sgr_attrs *b) {
+	return a->bold == b->bold && a->faint == b->faint &&
+	       a->italic == b->italic && a->underline == b->underline &&
+	       a->blink == b->blink && a->reverse == b->reverse &&
+	       a->fg == b->fg && a->bg == b->bg;
+}
+
+// Length of the complete escape sequence at s[0] == ESC, 0 if it isn't
+// complete within n bytes
+static size_t sequence_len(const char *s, size_t n) {
+	if (n < 2) return 0;
+	if (s[1] == '[') {  // CSI: parameters, intermediates, final byte
+		for (size_t i = 2; i < n; i++) {
+			unsigned char c = (unsigned char)s[i];
+			if (c >= 0x40 && c <= 0x7e) return i + 1;
+			if (c < 0x20 || c > 0x3f) return i;  // Malformed: stop before it
+		}
+		return 0;
+	}
+	if (s[1] == ']') {  // OSC: up to BEL or ST
+		for (size_t i = 2; i < n; i++) {
+			if (s[i] == '\a') return i + 1;
+			if (s[i] == ESC && i + 1 < n && s[i + 1] == '\\') return i + 2;
+		}
+		return 0;
+	}
+	return 2;
+}
+
+// Parse the numeric parameters of an SGR sequence; empty ones are 0
+// Returns the number of parameters, or -1 if the sequence has anything but
+// digits and ';' (e.g. ':' sub-parameters), which isn't modelled
+static int parse_params(const char *s, size_t len, unsigned *params,
+                        int max) {
+	int n = 0;
+	unsigned value = 0;
+	for (size_t i = 2; i + 1 < len; i++) {
+		if (s[i] >= '0' && s[i] <= '9') {
+			value = value * 10 + (s[i] - '0');
+			if (value > 0xffffff) return -1;
+		} else if (s[i] == ';') {
+			if (n == max) return -1;
+			params[n++] = value;
+			value = 0;
+		} else {
+			return -1;
+		}
+	}
+	if (n == max) return -1;
+	params[n++] = value;
+	return n;
+}
+
+// Apply SGR parameters to a state. Returns 0 if some parameter isn't
+// modelled, in which case the sequence has to be passed through as is.
+static int apply_params(hlmd_sgr_attrs *a, const unsigned *p, int n) {
+	int known = 1;
+	for (int i = 0; i < n; i++) {
+		unsigned v = p[i];
+		if (v == 0) {
+			memset(a, 0, sizeof(*a));
+		} else if (v == 1) {
+			a->bold = 1;
+		} else if (v == 2) {
+			a->faint = 1;
+		} else if (v == 3) {
+			a->italic = 1;
+		} else if (v == 4) {
+			a->underline = 1;
+		} else if (v == 5 || v == 6) {
+			a->blink = 1;
+		} else if (v == 7) {
+			a->reverse = 1;
+		} else if (v == 22) {
+			a->bold = a->faint = 0;
+		} else if (v == 23) {
+			a->italic = 0;
+		} else if (v == 24) {
+			a->underline = 0;
+		} else if (v == 25) {
+			a->blink = 0;
+		} else if (v == 27) {
+			a->reverse = 0;
+		} else if ((v >= 30 && v <= 37) || (v >= 90 && v <= 97)) {
+			a->fg = SGR_COLOR_BASIC | v;
+		} else if (v == 39) {
+			a->fg = 0;
+		} else if ((v >= 40 && v <= 47) || (v >= 100 && v <= 107)) {
+			a->bg = SGR_COLOR_BASIC | v;
+		} else if (v == 49) {
+			a->bg = 0;
+		} else if ((v == 38 || v == 48) && i + 2 < n && p[i + 1] == 5) {
+			uint32_t color = SGR_COLOR_INDEXED | (p[i + 2] & 0xff);
+			*(v == 38 ? &a->fg : &a->bg) = color;
+			i += 2;
+		} else if ((v == 38 || v == 48) && i + 4 < n && p[i + 1] == 2) {
+			uint32_t color = SGR_COLOR_RGB | (p[i + 2] & 0xff) << 16 |
+			                 (p[i + 3] & 0xff) << 8 | (p[i + 4] & 0xff);
+			*(v == 38 ? &a->fg : &a->bg) = color;
+			i += 4;
+		} else {
+			known = 0;
+		}
+	}
+	return known;
+}
+
+static void add_param(char *params, size_t *len, const char *fmt,
+                      unsigned a, unsigned b, unsigned c) {
+	if (*len) params[(*len)++] = ';';
+	*len += snprintf(params + *len, 64, fmt, a, b, c);
+}
+
+static void add_color(char *params, size_t *len, uint32_t color, int bg) {
+	uint32_t v = SGR_COLOR_VALUE(color);
+	switch (SGR_COLOR_KIND(color)) {
+	case 0:
+		add_param(params, len, "%u", bg ? 49 : 39, 0, 0);
+		break;
+	case SGR_COLOR_BASIC:
+		add_param(params, len, "%u", v, 0, 0);
+		break;
+	case SGR_COLOR_INDEXED:
+		add_param(params, len, "%u;5;%u", bg ? 48 : 38, v, 0);
+		break;
+	default:
+		add_param(params, len, bg ? "48;2;%u;%u;%u" : "38;2;%u;%u;%u",
+		          v >> 16, (v >> 8) & 0xff, v & 0xff);
+		break;
+	}
+}
+
+// Parameters that turn on everything in a set on top of the default state
+static size_t params_from_reset(const hlmd_sgr_attrs *want, char *params) {
+	size_t len = 0;
+	add_param(params, &len, "0", 0, 0, 0);
+	if (want->bold) add_param(params, &len, "1", 0, 0, 0);
+	if (want->faint) add_param(params, &len, "2", 0, 0, 0);
+	if (want->italic) add_param(params, &len, "3", 0, 0, 0);
+	if (want->underline) add_param(params, &len, "4", 0, 0, 0);
+	if (want->blink) add_param(params, &len, "5", 0, 0, 0);
+	if (want->reverse) add_param(params, &len, "7", 0, 0, 0);
+	if (want->fg) add_color(params, &len, want->fg, 0);
+	if (want->bg) add_color(params, &len, want->bg, 1);
+	return len;
+}
+
+// Parameters that change only what differs
+static size_t params_from_delta(const hlmd_sgr_attrs *term,
+                                const hlmd_sgr_attrs *want, char *params) {
+	size_t len = 0;
+	if ((term->bold && !want->bold) || (term->faint && !want->faint)) {
+		add_param(params, &len, "22", 0, 0, 0);
+		if (want->bold) add_param(params, &len, "1", 0, 0, 0);
+		if (want->faint) add_param(params, &len, "2", 0, 0, 0);
+	} else {
+		if (want->bold && !term->bold) add_param(params, &len, "1", 0, 0, 0);
+		if (want->faint && !term->faint) add_param(params, &len, "2", 0, 0, 0);
+	}
+	if (want->italic != term->italic) {
+		add_param(params, &len, want->italic ? "3" : "23", 0, 0, 0);
+	}
+	if (want->underline != term->underline) {
+		add_param(params, &len, want->underline ? "4" : "24", 0, 0, 0);
+	}
+	if (want->blink != term->blink) {
+		add_param(params, &len, want->blink ? "5" : "25", 0, 0, 0);
+	}
+	if (want->reverse != term->reverse) {
+		add_param(params, &len, want->reverse ? "7" : "27", 0, 0, 0);
+	}
+	if (want->fg != term->fg) add_color(params, &len, want->fg, 0);
+	if (want->bg != term->bg) add_color(params, &len, want->bg, 1);
+	return len;
+}
+
+// Bring the terminal to the requested state with the shorter of a delta
+// and a reset followed by the requested attributes
+static int sync(hlmd_sgr *st, buffer_t *out) {
+	if (attrs_equal(&st->term, &st->want)) return 1;
+	char delta[256], reset[256];
+	size_t delta_len = params_from_delta(&st->term, &st->want, delta);
+	size_t reset_len = params_from_reset(&st->want, reset);
+	const char *params = delta_len <= reset_len ? delta : reset;
+	size_t len = delta_len <= reset_len ? delta_len : reset_len;
+	st->term = st->want;
+	return buffer_append(out, "\033[", 2) && buffer_append(out, params, len) &&
+	       buffer_append(out, "m", 1);
+}
+
+// Handle one complete escape sequence
+static int handle_sequence(hlmd_sgr *st, const char *s, size_t len,
+                           buffer_t *out) {
+	unsigned params[32];
+	int n = -1;
+	if (len >= 3 && s[1] == '[' && s[len - 1] == 'm') {
+		n = parse_params(s, len, params, 32);
+	}
+	if (n >= 0) {
+		hlmd_sgr_attrs next = st->want;
+		if (apply_params(&next, params, n)) {
+			st->want = next;
+			return 1;
+		}
+	}
+
+	// Anything else (cursor motion, erase, unmodelled SGR) goes through as
+	// is, after the terminal has the state the input expects it in
+	if (!sync(st, out) || !buffer_append(out, s, len)) return 0;
+	if (n >= 0) {
+		apply_params(&st->want, params, n);
+		st->term = st->want;
+	}
+	return 1;
+}
+
+int hlmd_sgr_filter(hlmd_sgr *st, const char *in, size_t len,
+                    buffer_t *out) {
+	size_t i = 0;
+
+	// Finish a sequence the previous call ended in the middle of
+	while (st->partial_len > 0 && i < len) {
+		// Only a shorter sequence than the buffer is kept (below), but
+		// never write past it whatever partial_len says
+		if (st->partial_len < sizeof(st->partial)) {
+			st->partial[st->partial_len++] = in[i++];
+		}
+		size_t seq = sequence_len(st->partial, st->partial_len);
+		if (seq == 0 && st->partial_len < sizeof(st->partial)) continue;
+		if (seq == 0) seq = st->partial_len;  // Too long to be real: as is
+		size_t rest = st->partial_len - seq;
+		st->partial_len = 0;
+		if (!handle_sequence(st, st->partial, seq, out)) return 0;
+		i -= rest;  // A malformed sequence ended before the latest bytes
+	}
+
+	while (i < len) {
+		char c = in[i];
+		if (c == ESC) {
+			size_t seq = sequence_len(in + i, len - i);
+			if (seq == 0 && len - i >= sizeof(st->partial)) {
+				seq = len - i;  // Too long to be real: as is
+			} else if (seq == 0) {
+				size_t rest = len - i;
+				memcpy(st->partial, in + i, rest);
+				st->partial_len = rest;
+				i += rest;
+				continue;
+			}
+			if (!handle_sequence(st, in + i, seq, out)) return 0;
+			i += seq;
+			continue;
+		}
+
+		// Text up to the next escape or newline, drawn in the wanted state
+		size_t end = i;
+		while (end < len && in[end] != ESC && in[end] != '\n') end++;
+		if (end == i) end++;  // The newline itself, after syncing too
+		if (!sync(st, out) || !buffer_append(out, in + i, end - i)) return 0;
+		i = end;
+	}
+	return 1;
+}
+
+int hlmd_sgr_finish(hlmd_sgr *st, buffer_t *out) {
+	if (st->partial_len > 0) {
+		if (!buffer_append(out, st->partial, st->partial_len)) return 0;
+		st->partial_len = 0;
+	}
+	return sync(st, out);
+}
@@ -0,0 +1,43 @@
+#ifndef HLMD_SGR_H
+#define HLMD_SGR_H
+
+#include <stdint.h>
+
+#include "buffer.h"
+
+// Output stage that rewrites ANSI SGR ("\033[...m") sequences as minimal
+// deltas
+//
+// The tracker knows the attributes the terminal currently has and the ones
+// the input asks for, and only emits the difference right before the next
+// character that is drawn. Adjacent tokens in the same style merge, and
+// resets or colors that change nothing disappear. At every newline the
+// terminal is brought in sync, so each output line is complete on its own
+// and background colors never bleed into the next line.
+
+typedef struct {
+	unsigned char bold, faint, italic, underline, blink, reverse;
+	uint32_t fg;  // 0 = default, else SGR_COLOR_* kind in the top byte
+	uint32_t bg;
+} hlmd_sgr_attrs;
+
+typedef struct {
+	hlmd_sgr_attrs term;  // What the terminal has
+	hlmd_sgr_attrs want;  // What the input asked for so far
+	char partial[64];     // Escape sequence split across calls
+	size_t partial_len;
+} hlmd_sgr;
+
+// Start with the terminal in its default state
+void hlmd_sgr_init(hlmd_sgr *st);
+
+// Filter len bytes of ANSI text into out
+// Returns 1 on success, 0 on allocation failure
+int hlmd_sgr_filter(hlmd_sgr *st, const char *in, size_t len, buffer_t *out);
+
+// Emit whatever is needed for the terminal to match the requested state,
+// e.g. the final reset at end of output
+// Returns 1 on success, 0 on allocation failure
+int hlmd_sgr_finish(hlmd_sgr *st, buffer_t *out);
+
+#endif
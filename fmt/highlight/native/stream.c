@@ -0,0 +1,111 @@
+#include "stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hlmd.h"
+#include "sgr.h"
+
+struct hlmd_stream {
+	hlmd_state st;
+	hlmd_sgr sgr;
+	buffer_t line;      // Input after the last newline
+	buffer_t rendered;  // One line's engine output, before the SGR tracker
+	buffer_t out;       // Waiting to be drained, from drained on
+	size_t drained;
+	int finished;
+};
+
+int hlmd_stream_abi(void) { return HLMD_STREAM_ABI; }
+
+hlmd_stream *hlmd_stream_new(int columns) {
+	hlmd_stream *s = malloc(sizeof(*s));
+	if (!s) return NULL;
+	hlmd_init(&s->st);
+	s->st.hr_width = columns > 0 ? columns : 0;
+	hlmd_sgr_init(&s->sgr);
+	buffer_init(&s->line);
+	buffer_init(&s->rendered);
+	buffer_init(&s->out);
+	s->drained = 0;
+	s->finished = 0;
+	return s;
+}
+
+// Output is appended behind what is still waiting. Once everything has been
+// drained the buffer starts over, so it only grows while the caller lags.
+static void compact_out(hlmd_stream *s) {
+	if (s->drained == s->out.len) {
+		s->out.len = 0;
+		s->drained = 0;
+	}
+}
+
+// Render one complete line (or the unterminated last one) into out
+static int render_line(hlmd_stream *s, const char *line, size_t len) {
+	s->rendered.len = 0;
+	return hlmd_feed_line(&s->st, line, len, &s->rendered) &&
+	       hlmd_sgr_filter(&s->sgr, s->rendered.data, s->rendered.len,
+	                       &s->out);
+}
+
+int hlmd_stream_feed(hlmd_stream *s, const char *data, size_t len) {
+	if (s->finished) return 0;
+	compact_out(s);
+	while (len > 0) {
+		const char *nl = memchr(data, '\n', len);
+		if (!nl) return buffer_append(&s->line, data, len);
+
+		size_t n = nl - data + 1;
+		int ok;
+		if (s->line.len == 0) {
+			ok = render_line(s, data, n);  // Whole line in this chunk
+		} else {
+			ok = buffer_append(&s->line, data, n) &&
+			     render_line(s, s->line.data, s->line.len);
+			s->line.len = 0;
+		}
+		if (!ok) return 0;
+		data += n;
+		len -= n;
+	}
+	return 1;
+}
+
+int hlmd_stream_finish(hlmd_stream *s) {
+	if (s->finished) return 1;
+	s->finished = 1;
+	compact_out(s);
+	if (s->line.len > 0 && !render_line(s, s->line.data, s->line.len)) {
+		return 0;
+	}
+	s->line.len = 0;
+	s->rendered.len = 0;
+	return hlmd_finish(&s->st, &s->rendered) &&
+	       hlmd_sgr_filter(&s->sgr, s->rendered.data, s->rendered.len,
+	                       &s->out) &&
+	       hlmd_sgr_finish(&s->sgr, &s->out);
+}
+
+int hlmd_stream_truncated(const hlmd_stream *s) { return s->st.truncated; }
+
+size_t hlmd_stream_pending(const hlmd_stream *s) {
+	return s->out.len - s->drained;
+}
+
+size_t hlmd_stream_drain(hlmd_stream *s, char *out, size_t size) {
+	size_t n = hlmd_stream_pending(s);
+	if (n > size) n = size;
+	memcpy(out, s->out.data + s->drained, n);
+	s->drained += n;
+	compact_out(s);
+	return n;
+}
+
+void hlmd_stream_free(hlmd_stream *s) {
+	if (!s) return;
+	buffer_free(&s->line);
+	buffer_free(&s->rendered);
+	buffer_free(&s->out);
+	free(s);
+}
@@ -0,0 +1,59 @@
+#ifndef HLMD_STREAM_H
+#define HLMD_STREAM_H
+
+#include <stddef.h>  // For size_t
+
+// Embeddable streaming highlighter: what the hlmd binary does, behind a
+// small C ABI for programs that want to highlight in-process (no child
+// process, no pipes). Input can be fed in chunks of any size, split
+// anywhere, even inside a UTF-8 sequence; output comes out a line at a
+// time, as the native engine renders it, through the SGR tracker.
+//
+//   hlmd_stream *s = hlmd_stream_new(0);
+//   while (more input) {
+//       hlmd_stream_feed(s, data, len);
+//       while ((n = hlmd_stream_drain(s, out, sizeof(out)))) show(out, n);
+//   }
+//   hlmd_stream_finish(s);
+//   while ((n = hlmd_stream_drain(s, out, sizeof(out)))) show(out, n);
+//   hlmd_stream_free(s);
+//
+// The stream is opaque and owns all its memory. Functions never print;
+// failures are reported by return value only.
+
+// Bumped on incompatible changes to the functions below (new functions
+// alone don't bump it)
+#define HLMD_STREAM_ABI 1
+
+typedef struct hlmd_stream hlmd_stream;
+
+// HLMD_STREAM_ABI of the library that was loaded
+int hlmd_stream_abi(void);
+
+// New stream. columns is the width for horizontal rules, 0 to ask the
+// terminal ($COLUMNS or the stdout tty). Returns NULL on allocation failure.
+hlmd_stream *hlmd_stream_new(int columns);
+
+// Feed len bytes of markdown. Every complete line is rendered right away.
+// Returns 1 on success, 0 on allocation failure or after hlmd_stream_finish()
+int hlmd_stream_feed(hlmd_stream *s, const char *data, size_t len);
+
+// End of input: render the last line even without its newline and close
+// anything still open. Returns 1 on success, 0 on allocation failure
+int hlmd_stream_finish(hlmd_stream *s);
+
+// Nonzero once hlmd_stream_finish() had to close a code block whose fence
+// never ended: the input was probably cut short
+int hlmd_stream_truncated(const hlmd_stream *s);
+
+// Bytes of output waiting to be drained
+size_t hlmd_stream_pending(const hlmd_stream *s);
+
+// Copy up to size bytes of waiting output to out
+// Returns the number of bytes copied, 0 when there is nothing left
+size_t hlmd_stream_drain(hlmd_stream *s, char *out, size_t size);
+
+// Free a stream and everything it holds; NULL is ignored
+void hlmd_stream_free(hlmd_stream *s);
+
+#endif
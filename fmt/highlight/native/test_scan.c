@@ -0,0 +1,119 @@
+// Randomized check of every scan kernel this CPU runs against the scalar loop
+//
+// Built and run by `native/build test`. The kernels are static, so this
+// includes scan.c itself. Every length 0..64 at every alignment 0..31 is
+// tried with each special byte at each position, then with random bytes
+// (high ones included, for the signed compares), from every start.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scan.c"
+
+#define MAX_LEN 64
+#define MAX_ALIGN 32
+#define RANDOM_ROUNDS 2000
+
+static const char specials[] = {'`', '*', '_', '#', '\n', '\033'};
+
+typedef struct {
+	const char *name;
+	scan_fn fn;
+} kernel;
+
+static kernel kernels[4];
+static int nkernels;
+
+static void add_kernels(void) {
+#if defined(HLMD_SCAN_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		kernels[nkernels++] = (kernel){"sse2", scan_sse2};
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		kernels[nkernels++] = (kernel){"avx2", scan_avx2};
+	}
+#elif defined(HLMD_SCAN_NEON)
+	kernels[nkernels++] = (kernel){"neon", scan_neon};
+#endif
+	// The dispatcher, whichever kernel it picked
+	kernels[nkernels++] = (kernel){"dispatch", hlmd_scan_special};
+}
+
+static int failures;
+
+// Compare every kernel with scan_scalar() on s[0, len), from every start
+static void check(const char *s, size_t len, size_t align) {
+	for (size_t start = 0; start <= len; start++) {
+		size_t want = scan_scalar(s, start, len);
+		for (int k = 0; k < nkernels; k++) {
+			size_t got = kernels[k].fn(s, start, len);
+			if (got == want) continue;
+			if (failures++ < 10) {
+				fprintf(stderr,
+				        "test_scan: %s: len %zu align %zu start %zu: "
+				        "got %zu, want %zu\n",
+				        kernels[k].name, len, align, start, got, want);
+			}
+		}
+	}
+}
+
+// A byte that is never special, random otherwise
+static char plain_byte(void) {
+	char c;
+	do c = (char)(rand() & 0xff);
+	while (hlmd_special[(unsigned char)c]);
+	return c;
+}
+
+int main(void) {
+	add_kernels();
+	srand(1);
+
+	// Room past the end so a kernel reading beyond len would find specials
+	static char block[MAX_ALIGN + MAX_LEN + 64];
+	long cases = 0;
+	for (size_t align = 0; align < MAX_ALIGN; align++) {
+		char *s = block + align;
+		for (size_t len = 0; len <= MAX_LEN; len++) {
+			memset(block, '\n', sizeof(block));
+			for (size_t i = 0; i < len; i++) s[i] = plain_byte();
+			check(s, len, align);
+			cases++;
+
+			// Each special byte alone at each position
+			for (size_t pos = 0; pos < len; pos++) {
+				char saved = s[pos];
+				for (size_t c = 0; c < sizeof(specials); c++) {
+					s[pos] = specials[c];
+					check(s, len, align);
+					cases++;
+				}
+				s[pos] = saved;
+			}
+
+			// Random bytes, specials about one in eight
+			for (int round = 0; round < RANDOM_ROUNDS / MAX_LEN; round++) {
+				for (size_t i = 0; i < len; i++) {
+					s[i] = rand() % 8 ? (char)(rand() & 0xff)
+					                  : specials[rand() % sizeof(specials)];
+				}
+				check(s, len, align);
+				cases++;
+			}
+		}
+	}
+
+	for (int k = 0; k < nkernels; k++) {
+		printf("test_scan: checked %s\n", kernels[k].name);
+	}
+	if (failures) {
+		fprintf(stderr, "test_scan: %d mismatches in %ld cases\n", failures,
+		        cases);
+		return EXIT_FAILURE;
+	}
+	printf("test_scan: %ld cases ok\n", cases);
+	return EXIT_SUCCESS;
+}
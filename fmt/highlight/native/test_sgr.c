@@ -0,0 +1,61 @@
+// Escape sequences split across hlmd_sgr_filter() calls
+//
+// Built and run by `native/build test`. Sequences the filter doesn't model
+// go through as is, so each input here must come out unchanged however it
+// is split in two, and the partial buffer must never overflow.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgr.h"
+
+static int failures;
+
+static void check(const char *name, const char *in, size_t len) {
+	for (size_t split = 0; split <= len; split++) {
+		hlmd_sgr st;
+		buffer_t out;
+		hlmd_sgr_init(&st);
+		buffer_init(&out);
+		int ok = hlmd_sgr_filter(&st, in, split, &out) &&
+		         st.partial_len < sizeof(st.partial) &&
+		         hlmd_sgr_filter(&st, in + split, len - split, &out) &&
+		         hlmd_sgr_finish(&st, &out);
+		if (!ok || out.len != len || memcmp(out.data, in, len) != 0) {
+			if (failures++ < 10) {
+				fprintf(stderr, "test_sgr: %s: split at %zu: wrong output\n",
+				        name, split);
+			}
+		}
+		buffer_free(&out);
+	}
+}
+
+int main(void) {
+	char in[128];
+	size_t osc = sizeof(((hlmd_sgr *)0)->partial);
+
+	// An OSC as long as the partial buffer, never terminated
+	memcpy(in, "\033]", 2);
+	memset(in + 2, 'a', osc - 3);
+	in[osc - 1] = '\n';
+	memcpy(in + osc, "text\n", 5);
+	check("unterminated OSC", in, osc + 5);
+
+	// The same length ending in BEL
+	in[osc - 1] = '\a';
+	check("terminated OSC", in, osc + 5);
+
+	// One byte shorter, so it fits and is kept across the split
+	memcpy(in + osc - 1, "text\n", 5);
+	in[osc - 2] = '\a';
+	check("short OSC", in, osc + 4);
+
+	if (failures) {
+		fprintf(stderr, "test_sgr: %d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("test_sgr: split sequences ok\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,19 @@
+#ifndef HL_BACKEND_H
+#define HL_BACKEND_H
+
+// Which highlighter the driver runs. pygmentize.c defines it, or with
+// HL_BACKEND_RICH (rich.c) the rich one; every module is shared.
+typedef struct {
+	const char *name;         // Also the backend name coproc.py takes
+	const char *const *args;  // Command line of a per-render process
+	int wraps;                // Output depends on the terminal width
+	// The markdown lexer only knows a fence once it is closed: until then
+	// its code is plain text, and the closing line changes every line above
+	// it. Renders that stop inside a fence get a provisional close (see
+	// render_tail()), whose output line is dropped again.
+	int closes_fences;
+} backend_t;
+
+extern const backend_t backend;
+
+#endif
@@ -0,0 +1,460 @@
+#!/usr/bin/env python3
+# Stream replay benchmark for the highlight backends
+#
+# Replays markdown documents the way an LLM streams them (a few tokens at a
+# time, at a fixed token rate) into each backend and measures what the user
+# would see:
+#
+#   latency   time from writing a chunk to the first output after it, p50/p99
+#   cpu       user+system seconds of the backend and everything it waited for
+#   rss       peak resident set of the backend or its largest child
+#   bytes     bytes written to stdout
+#   rewrites  repaints (cursor up + clear to end of screen)
+#
+# usage: bench.py [--rate N] [--chunk N] [--backend NAME]... [--corpus NAME]...
+#                 [--pty] [--json FILE] [--compare FILE]
+#
+# Save a run with --json and pass it to --compare later: any metric that got
+# worse by more than --tolerance exits 1, so this can gate a change.
+
+import argparse
+import json
+import os
+import random
+import re
+import selectors
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.realpath(__file__))
+ROOT = os.path.dirname(HERE)  # fmt/highlight
+REWRITE = b"\033[J"
+
+WORDS = (
+    "the stream parser renders each block once tokens arrive and keeps "
+    "the terminal in sync while a model writes long answers with lists "
+    "tables links headers and fenced code in many languages"
+).split()
+
+CODE = {
+    "python": [
+        "def {w}({w2}, *args):",
+        '    """{s}"""',
+        "    for i in range(len({w2})):",
+        "        if {w2}[i] is None:  # {s}",
+        "            return {n}",
+        "    return {w}_{w2} + {n}",
+    ],
+    "c": [
+        "static int {w}(const char *{w2}, size_t len) {{",
+        "\tfor (size_t i = 0; i < len; i++) {{",
+        "\t\tif ({w2}[i] == '\\n') return {n};  // {s}",
+        "\t}}",
+        '\treturn printf("%s\\n", "{w2}");',
+        "}}",
+    ],
+    "js": [
+        "function {w}({w2}) {{",
+        "  const out = [];  // {s}",
+        "  for (const x of {w2}) out.push(x * {n});",
+        "  return out.filter(Boolean);",
+        "}}",
+    ],
+    "rust": [
+        "fn {w}({w2}: &[u8]) -> Option<usize> {{",
+        "    // {s}",
+        "    {w2}.iter().position(|&b| b == b'{c}').map(|i| i + {n})",
+        "}}",
+    ],
+    "json": [
+        "{{",
+        '  "{w}": {n},',
+        '  "{w2}": ["{s}", null, true],',
+        '  "nested": {{"{w}": {n}.5}}',
+        "}}",
+    ],
+    "diff": [
+        "--- a/{w}.c",
+        "+++ b/{w}.c",
+        "@@ -{n},3 +{n},4 @@",
+        " context {s}",
+        "-old {w2}",
+        "+new {w2}",
+    ],
+}
+
+
+def sentence(rng, words):
+    return " ".join(rng.choice(WORDS) for _ in range(words))
+
+
+def prose_line(rng):
+    parts = []
+    for _ in range(rng.randint(8, 20)):
+        word = rng.choice(WORDS)
+        style = rng.random()
+        if style < 0.05:
+            word = f"**{word}**"
+        elif style < 0.08:
+            word = f"_{word}_"
+        elif style < 0.12:
+            word = f"`{word}()`"
+        parts.append(word)
+    return " ".join(parts).capitalize() + "."
+
+
+def synthetic_fences(scale, rng):
+    out = []
+    for section in range(12 * scale):
+        out.append(f"## {sentence(rng, 4)} {section}\n\n{prose_line(rng)}\n\n")
+        lang = rng.choice(sorted(CODE))
+        out.append(f"```{lang}\n")
+        for _ in range(rng.randint(3, 8)):
+            for template in CODE[lang]:
+                fields = {
+                    "w": rng.choice(WORDS),
+                    "w2": rng.choice(WORDS),
+                    "s": sentence(rng, 5),
+                    "n": rng.randint(0, 999),
+                    "c": rng.choice("abcxyz"),
+                }
+                out.append(template.format(**fields) + "\n")
+        out.append("```\n\n")
+    return "".join(out)
+
+
+def synthetic_prose(scale, rng):
+    out = []
+    for section in range(6 * scale):
+        out.append(f"# {sentence(rng, 3)} {section}\n\n")
+        for _ in range(rng.randint(2, 4)):
+            # Long paragraphs: one source line per paragraph, as models do
+            out.append(" ".join(prose_line(rng) for _ in range(8)) + "\n\n")
+        for _ in range(rng.randint(2, 6)):
+            out.append(f"- {prose_line(rng)}\n")
+        out.append("\n")
+    return "".join(out)
+
+
+def load_corpora(names, scale, files):
+    rng = random.Random(1)
+    corpora = {}
+    for name in names:
+        if name == "test":
+            with open(os.path.join(HERE, "test.md")) as f:
+                corpora[name] = f.read()
+        elif name == "fences":
+            corpora[name] = synthetic_fences(scale, rng)
+        elif name == "prose":
+            corpora[name] = synthetic_prose(scale, rng)
+    for path in files:
+        with open(path) as f:
+            corpora[os.path.basename(path)] = f.read()
+    return corpora
+
+
+def tokenize(text):
+    """Splits text into pieces roughly the size of LLM tokens."""
+    return re.findall(r"\s*[^\s]{1,4}|\s+", text)
+
+
+# Backends are started through this so their peak RSS is their own: a child
+# forked from the interpreter keeps its high-water mark across exec
+LAUNCHER = r"""
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+int main(int argc, char **argv) {
+	if (argc < 3) return 2;  // launch usage-file argv...
+	pid_t pid = fork();
+	if (pid == 0) {
+		execvp(argv[2], argv + 2);
+		_exit(127);
+	}
+	int status = 0;
+	waitpid(pid, &status, 0);
+	struct rusage ru;
+	getrusage(RUSAGE_CHILDREN, &ru);
+	FILE *f = fopen(argv[1], "w");
+	fprintf(f, "%ld.%06ld %ld.%06ld %ld\n", ru.ru_utime.tv_sec,
+	        ru.ru_utime.tv_usec, ru.ru_stime.tv_sec, ru.ru_stime.tv_usec,
+	        ru.ru_maxrss);
+	fclose(f);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+"""
+
+
+# The backends are built warning-clean, so a change that adds a warning
+# fails the benchmark instead of passing unnoticed
+CFLAGS = ["-O2", "-Wall", "-Wextra", "-Werror"]
+
+
+def build_launcher(workdir, cc):
+    src = os.path.join(workdir, "launch.c")
+    with open(src, "w") as f:
+        f.write(LAUNCHER)
+    exe = os.path.join(workdir, "launch")
+    subprocess.run([cc, *CFLAGS, "-o", exe, src], check=True)
+    return exe
+
+
+def build_backends(names, workdir):
+    """Returns {name: (argv, env)} for the backends that can run here."""
+    backends = {}
+    cc = os.environ.get("CC", "cc")
+    launch = build_launcher(workdir, cc)
+
+    # coproc.py's shebang wants uv; without it, run it with this interpreter
+    coproc = os.path.join(HERE, "coproc.py")
+    if not shutil.which("uv"):
+        wrapper = os.path.join(workdir, "coproc.sh")
+        with open(wrapper, "w") as f:
+            f.write(f'#!/bin/sh\nexec "{sys.executable}" "{coproc}" "$@"\n')
+        os.chmod(wrapper, 0o755)
+        coproc = wrapper
+
+    built = False
+    for name in names:
+        if name in ("pygmentize", "rich"):
+            if name == "rich" and not have_module("rich"):
+                print("bench: skipping rich (not installed)", file=sys.stderr)
+                continue
+            if not built:
+                env = dict(os.environ, CC=cc, CFLAGS=" ".join(CFLAGS))
+                subprocess.run(
+                    [os.path.join(HERE, "build")],
+                    check=True,
+                    env=env,
+                    stdout=subprocess.DEVNULL,
+                )
+                built = True
+            exe = os.path.join(HERE, name)
+            backends[name] = ([exe], {"HLMD_COPROC": coproc})
+        elif name == "hlmd-st":
+            script = os.path.join(ROOT, "hlmd-st.py")
+            backends[name] = ([sys.executable, script], {})
+        elif name == "native":
+            exe = os.path.join(ROOT, "native", "hlmd")
+            subprocess.run(
+                [os.path.join(ROOT, "native", "build")],
+                check=True,
+                stdout=subprocess.DEVNULL,
+            )
+            backends[name] = ([exe], {})
+    return {
+        name: ([launch, os.path.join(workdir, f"{name}.usage")] + argv, env)
+        for name, (argv, env) in backends.items()
+    }
+
+
+def have_module(name):
+    import importlib.util
+
+    return importlib.util.find_spec(name) is not None
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def open_output(use_pty, columns, rows):
+    """Returns (read_fd, child_stdout_fd) for the backend's stdout."""
+    if not use_pty:
+        return os.pipe()
+    import fcntl
+    import pty
+    import struct
+    import termios
+    import tty
+
+    master, slave = pty.openpty()
+    tty.setraw(slave)  # No \n -> \r\n, so byte counts match pipe mode
+    size = struct.pack("HHHH", rows, columns, 0, 0)
+    fcntl.ioctl(slave, termios.TIOCSWINSZ, size)
+    return master, slave
+
+
+def run_one(argv, extra_env, text, args):
+    """Streams text into one backend and returns its metrics."""
+    tokens = tokenize(text)
+    chunks = [
+        "".join(tokens[i : i + args.chunk]).encode()
+        for i in range(0, len(tokens), args.chunk)
+    ]
+    interval = args.chunk / args.rate if args.rate > 0 else 0
+
+    env = dict(os.environ, TERM="xterm-256color", COLUMNS=str(args.columns))
+    env.update(extra_env)
+    out_r, out_w = open_output(args.pty, args.columns, args.rows)
+    proc = subprocess.Popen(
+        argv, stdin=subprocess.PIPE, stdout=out_w, stderr=subprocess.DEVNULL, env=env
+    )
+    os.close(out_w)
+    os.set_blocking(proc.stdin.fileno(), False)
+
+    sel = selectors.DefaultSelector()
+    sel.register(out_r, selectors.EVENT_READ)
+    pending = []  # Write times of chunks with no output after them yet
+    latencies = []
+    output = bytearray()
+    queue = b""
+    next_chunk = 0
+    start = time.monotonic()
+    stdin_open = True
+
+    while True:
+        now = time.monotonic()
+        while next_chunk < len(chunks) and now >= start + next_chunk * interval:
+            queue += chunks[next_chunk]
+            pending.append(now)
+            next_chunk += 1
+        if queue:
+            try:
+                queue = queue[os.write(proc.stdin.fileno(), queue) :]
+            except BlockingIOError:
+                pass
+        if stdin_open and next_chunk == len(chunks) and not queue:
+            proc.stdin.close()
+            stdin_open = False
+
+        if next_chunk < len(chunks) and not queue:
+            timeout = max(0, start + next_chunk * interval - time.monotonic())
+        else:
+            timeout = 0.001 if queue else None
+        events = sel.select(timeout)
+        if not events:
+            continue
+        try:
+            data = os.read(out_r, 65536)
+        except OSError:  # EIO from a pty once the child has exited
+            data = b""
+        if not data:
+            break
+        now = time.monotonic()
+        latencies.extend(now - t for t in pending)
+        pending.clear()
+        output += data
+
+    end = time.monotonic()
+    latencies.extend(end - t for t in pending)
+    sel.close()
+    os.close(out_r)
+    proc.wait()
+    with open(argv[1]) as f:
+        utime, stime, maxrss = f.read().split()
+    return {
+        "p50_ms": round(percentile(latencies, 50) * 1000, 2),
+        "p99_ms": round(percentile(latencies, 99) * 1000, 2),
+        "cpu_s": round(float(utime) + float(stime), 3),
+        "rss_mb": round(int(maxrss) / 1024, 1),
+        "bytes": len(output),
+        "rewrites": output.count(REWRITE),
+        "wall_s": round(end - start, 3),
+        "exit": proc.returncode,
+    }
+
+
+COLUMNS = ["p50_ms", "p99_ms", "cpu_s", "rss_mb", "bytes", "rewrites", "wall_s"]
+
+# Metrics compared by --compare, with a floor under which noise dominates
+GATED = {"p50_ms": 1.0, "p99_ms": 2.0, "cpu_s": 0.05, "rss_mb": 2.0}
+EXACT = ["bytes", "rewrites"]
+
+
+def run_key(r):
+    """Runs are only comparable with the same document, backend and feed."""
+    return r["corpus"], r["backend"], r["rate"], r["chunk"], r["pty"]
+
+
+def compare(results, baseline, tolerance):
+    """Returns the list of regressions against a saved run."""
+    old = {run_key(r): r for r in baseline}
+    problems = []
+    for r in results:
+        ref = old.get(run_key(r))
+        if not ref:
+            continue
+        for key, floor in GATED.items():
+            if r[key] > max(ref[key] * (1 + tolerance), ref[key] + floor):
+                problems.append((r, key, ref[key]))
+        for key in EXACT:
+            if r[key] > ref[key] * (1 + tolerance):
+                problems.append((r, key, ref[key]))
+    return problems
+
+
+def main():
+    parser = argparse.ArgumentParser(description="stream replay benchmark")
+    parser.add_argument(
+        "--rate", type=float, default=500, help="tokens/s (0 = unpaced)"
+    )
+    parser.add_argument("--chunk", type=int, default=4, help="tokens per write")
+    parser.add_argument(
+        "--backend",
+        action="append",
+        choices=["pygmentize", "rich", "hlmd-st", "native"],
+        help="backend to run (repeatable, default all)",
+    )
+    parser.add_argument(
+        "--corpus",
+        action="append",
+        choices=["test", "fences", "prose"],
+        help="built-in document (repeatable, default all)",
+    )
+    parser.add_argument("--file", action="append", default=[], help="extra document")
+    parser.add_argument("--scale", type=int, default=1, help="synthetic size factor")
+    parser.add_argument(
+        "--repeat", type=int, default=1, help="runs per pair (best kept)"
+    )
+    parser.add_argument("--pty", action="store_true", help="stdout is a terminal")
+    parser.add_argument("--columns", type=int, default=80)
+    parser.add_argument("--rows", type=int, default=24)
+    parser.add_argument("--json", help="write results here")
+    parser.add_argument("--compare", help="results of an earlier --json run")
+    parser.add_argument("--tolerance", type=float, default=0.25)
+    args = parser.parse_args()
+
+    backend_names = args.backend or ["pygmentize", "rich", "hlmd-st", "native"]
+    corpus_names = args.corpus or ([] if args.file else ["test", "fences", "prose"])
+    corpora = load_corpora(corpus_names, args.scale, args.file)
+
+    results = []
+    with tempfile.TemporaryDirectory(prefix="hlmd-bench") as workdir:
+        backends = build_backends(backend_names, workdir)
+        print(f"{'corpus':<10} {'backend':<11}" + "".join(f"{c:>10}" for c in COLUMNS))
+        for corpus, text in corpora.items():
+            for backend, (argv, env) in backends.items():
+                runs = [run_one(argv, env, text, args) for _ in range(args.repeat)]
+                best = min(runs, key=lambda r: r["cpu_s"])
+                feed = {"rate": args.rate, "chunk": args.chunk, "pty": args.pty}
+                results.append({"corpus": corpus, "backend": backend, **feed, **best})
+                row = "".join(f"{best[c]:>10}" for c in COLUMNS)
+                note = f"  (exit {best['exit']})" if best["exit"] else ""
+                print(f"{corpus:<10} {backend:<11}{row}{note}", flush=True)
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(results, f, indent=1)
+    if args.compare:
+        with open(args.compare) as f:
+            problems = compare(results, json.load(f), args.tolerance)
+        for r, key, before in problems:
+            print(
+                f"regression: {r['corpus']}/{r['backend']} {key} "
+                f"{before} -> {r[key]}",
+                file=sys.stderr,
+            )
+        if problems:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
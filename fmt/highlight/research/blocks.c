@@ -0,0 +1,31 @@
+#include "blocks.h"
+
+#include <string.h>
+
+int block_boundary(block_state_t *bs, const char *line, size_t len) {
+	size_t i = 0;
+	while (i < len && (line[i] == ' ' || line[i] == '\t')) i++;
+
+	if (len - i >= 3 && memcmp(line + i, "```", 3) == 0) {
+		bs->in_paragraph = 0;
+		bs->in_fence = !bs->in_fence;
+		return !bs->in_fence;  // A closed fence
+	}
+	if (bs->in_fence) return 0;
+
+	int blank = 1;
+	for (; i < len; i++) {
+		if (line[i] != '\n' && line[i] != '\r' && line[i] != ' ' &&
+		    line[i] != '\t') {
+			blank = 0;
+			break;
+		}
+	}
+	if (!blank) {
+		bs->in_paragraph = 1;
+		return 0;
+	}
+	int ended = bs->in_paragraph;  // A blank line after a paragraph
+	bs->in_paragraph = 0;
+	return ended;
+}
@@ -0,0 +1,17 @@
+#ifndef HL_BLOCKS_H
+#define HL_BLOCKS_H
+
+#include <stddef.h>  // For size_t
+
+// Just enough markdown block structure to spot boundaries that later input
+// can no longer change
+typedef struct {
+	int in_fence;
+	int in_paragraph;  // Last line was non-blank text outside a fence
+} block_state_t;
+
+// Feed one input line. Returns 1 if it ends a block, i.e. everything up to
+// and including this line renders the same whatever comes next.
+int block_boundary(block_state_t *bs, const char *line, size_t len);
+
+#endif
@@ -0,0 +1,59 @@
+#include "buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void buffer_init(buffer_t *buf) {
+	buf->data = NULL;
+	buf->len = 0;
+	buf->capacity = 0;
+}
+
+int buffer_reserve(buffer_t *buf, size_t extra) {
+	if (buf->len + extra > buf->capacity) {
+		size_t new_capacity =
+		    buf->capacity ? buf->capacity * 2 : READ_CHUNK_SIZE;
+		while (new_capacity < buf->len + extra) {
+			new_capacity *= 2;
+		}
+		char *new_data = realloc(buf->data, new_capacity);
+		if (!new_data) {
+			perror("realloc failed in buffer_reserve");
+			return 0;  // Failure
+		}
+		buf->data = new_data;
+		buf->capacity = new_capacity;
+	}
+	return 1;  // Success
+}
+
+int buffer_append(buffer_t *buf, const char *data, size_t len) {
+	if (!buffer_reserve(buf, len)) return 0;
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+	return 1;  // Success
+}
+
+void buffer_reset(buffer_t *buf) { buf->len = 0; }
+
+void buffer_shrink(buffer_t *buf) {
+	if (buf->capacity < RELEASE_MIN || buf->capacity / 4 < buf->len) return;
+	size_t new_capacity = buf->len * 2;
+	if (new_capacity < RELEASE_MIN) new_capacity = RELEASE_MIN;
+	char *new_data = realloc(buf->data, new_capacity);
+	if (!new_data) return;  // Still valid at the old size
+	buf->data = new_data;
+	buf->capacity = new_capacity;
+}
+
+void buffer_swap(buffer_t *a, buffer_t *b) {
+	buffer_t tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+void buffer_free(buffer_t *buf) {
+	free(buf->data);
+	buffer_init(buf);  // Reset state
+}
@@ -0,0 +1,42 @@
+#ifndef HL_BUFFER_H
+#define HL_BUFFER_H
+
+#include <stddef.h>  // For size_t
+
+#define READ_CHUNK_SIZE 4096
+
+// Freed regions smaller than this are not worth a memmove() or realloc()
+#define RELEASE_MIN (64 * 1024)
+
+// Structure to hold dynamically growing buffer
+typedef struct {
+	char *data;
+	size_t len;
+	size_t capacity;
+} buffer_t;
+
+// Initialize a buffer
+void buffer_init(buffer_t *buf);
+
+// Make room for at least extra more bytes, reallocating if necessary
+// Returns 1 on success, 0 on allocation failure
+int buffer_reserve(buffer_t *buf, size_t extra);
+
+// Append data to a buffer, reallocating if necessary
+// Returns 1 on success, 0 on allocation failure
+int buffer_append(buffer_t *buf, const char *data, size_t len);
+
+// Empty a buffer but keep its allocation for reuse
+void buffer_reset(buffer_t *buf);
+
+// Give back most of an allocation that is far larger than its contents,
+// e.g. after one huge block. Keeps twice the contents for regrowth.
+void buffer_shrink(buffer_t *buf);
+
+// Exchange two buffers' contents and allocations
+void buffer_swap(buffer_t *a, buffer_t *b);
+
+// Free buffer memory
+void buffer_free(buffer_t *buf);
+
+#endif
@@ -0,0 +1,196 @@
+#define _POSIX_C_SOURCE 200809L
+#include "cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "backend.h"
+#include "hash.h"
+#include "io.h"
+#include "stats.h"
+#include "term.h"
+
+#define CACHE_FORMAT 2
+#define DEFAULT_CACHE_MAX (64 * 1024 * 1024)
+
+// The highlighter's executable as found in PATH, as mtime, size and inode:
+// an upgrade replaces it, which changes every key
+static void backend_stamp(char *stamp, size_t size) {
+	const char *const *args = backend.args;
+	const char *path = getenv("PATH");
+	snprintf(stamp, size, "-");
+	while (path && *path) {
+		const char *colon = strchr(path, ':');
+		size_t len = colon ? (size_t)(colon - path) : strlen(path);
+		char file[PATH_MAX];
+		struct stat st;
+		snprintf(file, sizeof(file), "%.*s/%s", (int)len, path, args[0]);
+		if (len > 0 && stat(file, &st) == 0 && S_ISREG(st.st_mode)) {
+			snprintf(stamp, size, "%lld:%lld:%llu", (long long)st.st_mtime,
+			         (long long)st.st_size, (unsigned long long)st.st_ino);
+			return;
+		}
+		path = colon ? colon + 1 : NULL;
+	}
+}
+
+void cache_key(const char *data, size_t size, char *name, size_t name_size) {
+	hash_state_t h;
+	hash_init(&h);
+	char stamp[128];
+	backend_stamp(stamp, sizeof(stamp));
+	hash_word(&h, CACHE_FORMAT);
+	hash_string(&h, backend.name);
+	hash_string(&h, stamp);
+	hash_string(&h, getenv("TERM"));
+	hash_string(&h, getenv("COLORTERM"));
+	hash_string(&h, getenv("NO_COLOR"));
+	if (backend.wraps) {
+		int columns, rows;
+		terminal_size(&columns, &rows);
+		hash_word(&h, columns);
+	}
+	hash_update(&h, data, size);
+	hash128_t key = hash_final(&h);
+	snprintf(name, name_size, "%016llx%016llx.ansi",
+	         (unsigned long long)key.a, (unsigned long long)key.b);
+}
+
+// mkdir -p
+static int make_dirs(char *path) {
+	for (char *p = path + 1; *p; p++) {
+		if (*p != '/') continue;
+		*p = '\0';
+		int ok = mkdir(path, 0700) == 0 || errno == EEXIST;
+		*p = '/';
+		if (!ok) return 0;
+	}
+	return mkdir(path, 0700) == 0 || errno == EEXIST;
+}
+
+int cache_dir(char *path, size_t size, int requested) {
+	const char *env = getenv("HLMD_CACHE_DIR");
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	if (env && *env) {
+		snprintf(path, size, "%s", env);
+	} else if (!requested) {
+		return 0;
+	} else if (xdg && *xdg) {
+		snprintf(path, size, "%s/hinata/highlight", xdg);
+	} else if (home && *home) {
+		snprintf(path, size, "%s/.cache/hinata/highlight", home);
+	} else {
+		return 0;
+	}
+	if (!make_dirs(path)) {
+		perror("Failed to create cache directory");
+		return 0;
+	}
+	return 1;
+}
+
+int cache_lookup(const char *file) {
+	int fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) return 0;
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+	char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		close(fd);
+		return 0;
+	}
+	futimens(fd, NULL);  // Most recently used
+	close(fd);
+	int ok = write_stdout(data, st.st_size);
+	if (!ok) perror("Failed to write output");
+	munmap(data, st.st_size);
+	stats.output_bytes = st.st_size;
+	stats.branch = "cached";
+	return ok ? 1 : -1;
+}
+
+typedef struct {
+	char name[64];
+	off_t size;
+	struct timespec used;
+} cache_entry_t;
+
+static int cache_entry_cmp(const void *a, const void *b) {
+	const struct timespec *x = &((const cache_entry_t *)a)->used;
+	const struct timespec *y = &((const cache_entry_t *)b)->used;
+	if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+	return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+// Delete least recently used entries until the cache fits in max bytes
+static void cache_evict(const char *dir, size_t max) {
+	DIR *dp = opendir(dir);
+	if (!dp) return;
+	cache_entry_t *entries = NULL;
+	size_t count = 0, capacity = 0;
+	size_t total = 0;
+	struct dirent *de;
+	while ((de = readdir(dp))) {
+		size_t len = strlen(de->d_name);
+		if (len < 5 || len >= sizeof(entries->name) ||
+		    strcmp(de->d_name + len - 5, ".ansi") != 0 ||
+		    de->d_name[0] == '.') {
+			continue;  // Not an entry, or a write in progress
+		}
+		struct stat st;
+		if (fstatat(dirfd(dp), de->d_name, &st, 0) == -1) continue;
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			cache_entry_t *grown =
+			    realloc(entries, capacity * sizeof(cache_entry_t));
+			if (!grown) break;
+			entries = grown;
+		}
+		cache_entry_t *e = &entries[count++];
+		memcpy(e->name, de->d_name, len + 1);
+		e->size = st.st_size;
+		e->used = st.st_mtim;
+		total += st.st_size;
+	}
+
+	if (total > max) {
+		qsort(entries, count, sizeof(cache_entry_t), cache_entry_cmp);
+		for (size_t i = 0; i < count && total > max; i++) {
+			if (unlinkat(dirfd(dp), entries[i].name, 0) == 0) {
+				total -= entries[i].size;
+			}
+		}
+	}
+	free(entries);
+	closedir(dp);
+}
+
+void cache_store(const char *dir, const char *name, const buffer_t *out) {
+	char file[PATH_MAX], tmp[PATH_MAX];
+	snprintf(file, sizeof(file), "%s/%s", dir, name);
+	snprintf(tmp, sizeof(tmp), "%s/.%s.%d", dir, name, (int)getpid());
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd == -1) return;
+	int ok = write_all(fd, out->data, out->len);
+	if (close(fd) == -1) ok = 0;
+	if (!ok || rename(tmp, file) == -1) {
+		unlink(tmp);
+		return;
+	}
+
+	const char *env = getenv("HLMD_CACHE_MAX");
+	size_t max = env && *env ? strtoull(env, NULL, 10) : DEFAULT_CACHE_MAX;
+	cache_evict(dir, max);
+}
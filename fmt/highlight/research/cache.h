@@ -0,0 +1,31 @@
+#ifndef HL_CACHE_H
+#define HL_CACHE_H
+
+#include <stddef.h>  // For size_t
+
+#include "buffer.h"
+
+// Rendered files can be kept in a cache directory, so showing the same
+// conversation message again is one mmap() and write(). Entries are named
+// by a hash of the input and of everything else the output depends on
+// (cache_key()), written to a temporary name and renamed into place, and
+// evicted least recently used first (a hit bumps the mtime) once the
+// directory holds more than HLMD_CACHE_MAX bytes.
+
+// Cache file name for rendering data in this environment: the backend and
+// its version, the color settings both backends pick formatters by, and
+// with a wrapping backend the terminal width
+void cache_key(const char *data, size_t size, char *name, size_t name_size);
+
+// $HLMD_CACHE_DIR, else with --cache hinata/highlight under $XDG_CACHE_HOME
+// (default ~/.cache), created if missing. Returns 0 if caching is off.
+int cache_dir(char *path, size_t size, int requested);
+
+// Write a cached render to stdout. Returns 1 on a hit, 0 on a miss, -1 if
+// writing failed
+int cache_lookup(const char *file);
+
+// Save a render under its key, then trim the cache
+void cache_store(const char *dir, const char *name, const buffer_t *out);
+
+#endif
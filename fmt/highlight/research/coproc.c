@@ -0,0 +1,370 @@
+#define _GNU_SOURCE  // For tee(), only used on Linux
+#include "coproc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "backend.h"
+#include "stats.h"
+
+// Response bytes read per read() from a per-render child
+#define OUTPUT_CHUNK_SIZE 4096
+
+void frame_header(unsigned char *header, size_t len) {
+	header[0] = len >> 24;
+	header[1] = len >> 16;
+	header[2] = len >> 8;
+	header[3] = len;
+}
+
+size_t frame_length(const unsigned char *header) {
+	return (size_t)header[0] << 24 | (size_t)header[1] << 16 |
+	       (size_t)header[2] << 8 | header[3];
+}
+
+// Send a request to a highlighter child and collect its response at the same
+// time, so neither side can block on a full pipe while the other waits.
+//
+// write_fd must be non-blocking. The iovecs are consumed in place.
+// framed = 0: close write_fd once everything is sent, read until EOF
+// framed = 1: keep write_fd open, read one FRAME_HEADER_SIZE length prefix
+//             plus that many payload bytes (the prefix is not stored)
+// Output is appended to out and read straight into its storage. If sink is
+// given, the payload is also duplicated into sink->fd as it arrives.
+// Returns 1 on success, 0 on failure (the child died mid-frame, I/O errors)
+static int pipe_exchange(int write_fd, struct iovec *iov, int iovcnt,
+                         int read_fd, buffer_t *out, int framed,
+                         tee_t *sink) {
+	unsigned char header[FRAME_HEADER_SIZE];
+	size_t header_got = 0;
+	size_t start = out->len;
+	size_t want = SIZE_MAX;  // Payload length, once known
+	int writing = 1;
+	int reading = 1;
+	long long phase = stats_clock();  // Start of the write, then read phase
+
+	while (writing || reading) {
+		struct pollfd fds[2];
+		int nfds = 0;
+		int read_idx = -1;
+		int write_idx = -1;
+
+		if (writing && iovcnt == 0) {
+			if (!framed) close(write_fd);  // EOF for the child's stdin
+			writing = 0;
+			stats_since(&stats.write_us, phase);
+			phase = stats_clock();
+			continue;
+		}
+		if (writing) {
+			write_idx = nfds;
+			fds[nfds++] = (struct pollfd){.fd = write_fd, .events = POLLOUT};
+		}
+		if (reading) {
+			read_idx = nfds;
+			fds[nfds++] = (struct pollfd){.fd = read_fd, .events = POLLIN};
+		}
+
+		if (poll(fds, nfds, -1) == -1) {
+			if (errno == EINTR) continue;
+			perror("poll failed");
+			if (writing && !framed) close(write_fd);
+			return 0;
+		}
+
+		if (write_idx >= 0 && fds[write_idx].revents) {
+			ssize_t n = writev(write_fd, iov, iovcnt);
+			if (n >= 0) {
+				iov_advance(&iov, &iovcnt, n);
+			} else if (errno != EAGAIN && errno != EINTR) {
+				// EPIPE means the child exited early; read what it left
+				if (errno != EPIPE) perror("write to child stdin failed");
+				if (framed) return 0;
+				close(write_fd);
+				writing = 0;
+				stats_since(&stats.write_us, phase);
+				phase = stats_clock();
+			}
+		}
+
+		if (read_idx >= 0 && fds[read_idx].revents) {
+			ssize_t n;
+			if (framed && header_got < FRAME_HEADER_SIZE) {
+				n = read(read_fd, header + header_got,
+				         FRAME_HEADER_SIZE - header_got);
+			} else {
+				size_t room = OUTPUT_CHUNK_SIZE;
+				if (want - (out->len - start) < room) {
+					room = want - (out->len - start);
+				}
+				if (!buffer_reserve(out, room)) {
+					if (writing && !framed) close(write_fd);
+					return 0;
+				}
+				int teed = 0;
+#ifdef __linux__
+				if (sink && sink->fd >= 0) {
+					// Duplicate what is in the pipe, then consume exactly that
+					ssize_t t = tee(read_fd, sink->fd, room, 0);
+					if (t > 0) {
+						room = t;
+						teed = 1;
+					} else if (t < 0 && errno != EINTR && errno != EAGAIN) {
+						sink->fd = -1;  // Not a pipe after all: plain writes
+					}
+				}
+#endif
+				n = read(read_fd, out->data + out->len, room);
+				if (n > 0 && teed) {
+					sink->copied += n;
+					stats.stdout_bytes += n;
+				}
+			}
+
+			if (n < 0) {
+				if (errno == EINTR || errno == EAGAIN) continue;
+				perror("read from child stdout failed");
+				if (writing && !framed) close(write_fd);
+				return 0;
+			}
+			if (n == 0) {  // EOF
+				if (writing && !framed) close(write_fd);
+				if (framed) return 0;  // Child died mid-response
+				reading = 0;
+				continue;
+			}
+
+			if (framed && header_got < FRAME_HEADER_SIZE) {
+				header_got += n;
+				if (header_got == FRAME_HEADER_SIZE) {
+					want = frame_length(header);
+					// One allocation for the whole payload, if any
+					if (!buffer_reserve(out, want)) return 0;
+				}
+			} else {
+				out->len += n;
+			}
+			if (framed && out->len - start == want) reading = 0;
+		}
+	}
+	stats_since(&stats.read_us, phase);
+	return 1;
+}
+
+int run_pygmentize(const char *input_data, size_t input_len, buffer_t *out,
+                   tee_t *sink) {
+	int stdin_pipe[2];   // Pipe for sending data to pygmentize's stdin
+	int stdout_pipe[2];  // Pipe for receiving data from pygmentize's stdout
+	pid_t pid;
+	long long spawn = stats_clock();
+
+	if (pipe(stdin_pipe) == -1 || pipe(stdout_pipe) == -1) {
+		perror("pipe failed");
+		// Close any pipes that were opened successfully
+		if (stdin_pipe[0] != -1) close(stdin_pipe[0]);
+		if (stdin_pipe[1] != -1) close(stdin_pipe[1]);
+		if (stdout_pipe[0] != -1) close(stdout_pipe[0]);
+		if (stdout_pipe[1] != -1) close(stdout_pipe[1]);
+		return 0;
+	}
+
+	pid = fork();
+	if (pid == -1) {
+		perror("fork failed");
+		close(stdin_pipe[0]);
+		close(stdin_pipe[1]);
+		close(stdout_pipe[0]);
+		close(stdout_pipe[1]);
+		return 0;
+	}
+
+	if (pid == 0) {  // Child process
+		// Close unused pipe ends
+		close(stdin_pipe[1]);   // Close write end of stdin pipe
+		close(stdout_pipe[0]);  // Close read end of stdout pipe
+
+		// Redirect stdin to read from the stdin pipe
+		if (dup2(stdin_pipe[0], STDIN_FILENO) == -1) {
+			perror("dup2 stdin failed");
+			_exit(EXIT_FAILURE);  // Use _exit in child after fork
+		}
+		close(stdin_pipe[0]);  // Close original fd
+
+		// Redirect stdout to write to the stdout pipe
+		if (dup2(stdout_pipe[1], STDOUT_FILENO) == -1) {
+			perror("dup2 stdout failed");
+			_exit(EXIT_FAILURE);
+		}
+		close(stdout_pipe[1]);  // Close original fd
+
+		// Prepare arguments for the highlighter
+		const char *const *args = backend.args;
+
+		// Execute the highlighter
+		execvp(args[0], (char *const *)args);
+
+		// If execvp returns, it failed
+		fprintf(stderr, "execvp %s failed: %s\n", args[0], strerror(errno));
+		fprintf(stderr, "Ensure '%s' is installed and in your PATH.\n",
+		        args[0]);
+		_exit(EXIT_FAILURE);
+
+	} else {  // Parent process
+		// Close unused pipe ends
+		close(stdin_pipe[0]);   // Close read end of stdin pipe
+		close(stdout_pipe[1]);  // Close write end of stdout pipe
+		stats_since(&stats.spawn_us, spawn);
+
+		// Feed pygmentize's stdin and drain its stdout together. The write
+		// end is closed inside once all input is sent (EOF for the child).
+		fcntl(stdin_pipe[1], F_SETFL, O_NONBLOCK);
+		struct iovec iov = {(void *)input_data, input_len};
+		int ok =
+		    pipe_exchange(stdin_pipe[1], &iov, 1, stdout_pipe[0], out, 0, sink);
+		close(stdout_pipe[0]);  // Close read end
+
+		if (!ok) {
+			waitpid(pid, NULL, 0);  // Clean up zombie process
+			return 0;
+		}
+
+		// Wait for child process to terminate and check status
+		int status;
+		waitpid(pid, &status, 0);
+		if (!(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+			fprintf(stderr,
+			        "Warning: %s process did not exit cleanly (status %d).\n",
+			        backend.name, WEXITSTATUS(status));
+			// Continue anyway, maybe got partial output
+		}
+
+		return 1;
+	}
+}
+
+void coproc_script_path(char *path, size_t size) {
+	const char *env = getenv("HLMD_COPROC");
+	if (env && *env) {
+		snprintf(path, size, "%s", env);
+		return;
+	}
+
+	char exe[PATH_MAX];
+	ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	char *slash = n > 0 ? (exe[n] = '\0', strrchr(exe, '/')) : NULL;
+	if (slash) {
+		*slash = '\0';
+		snprintf(path, size, "%s/%s", exe, COPROC_SCRIPT);
+	} else {
+		snprintf(path, size, "./%s", COPROC_SCRIPT);
+	}
+}
+
+int coproc_start(coproc_t *cp) {
+	int stdin_pipe[2];
+	int stdout_pipe[2];
+	char script[PATH_MAX];
+
+	coproc_script_path(script, sizeof(script));
+
+	if (pipe(stdin_pipe) == -1) {
+		perror("pipe failed");
+		return 0;
+	}
+	if (pipe(stdout_pipe) == -1) {
+		perror("pipe failed");
+		close(stdin_pipe[0]);
+		close(stdin_pipe[1]);
+		return 0;
+	}
+
+	cp->pid = fork();
+	if (cp->pid == -1) {
+		perror("fork failed");
+		close(stdin_pipe[0]);
+		close(stdin_pipe[1]);
+		close(stdout_pipe[0]);
+		close(stdout_pipe[1]);
+		return 0;
+	}
+
+	if (cp->pid == 0) {  // Child process
+		close(stdin_pipe[1]);
+		close(stdout_pipe[0]);
+		if (dup2(stdin_pipe[0], STDIN_FILENO) == -1 ||
+		    dup2(stdout_pipe[1], STDOUT_FILENO) == -1) {
+			perror("dup2 failed");
+			_exit(EXIT_FAILURE);
+		}
+		close(stdin_pipe[0]);
+		close(stdout_pipe[1]);
+
+		const char *args[] = {script, backend.name, NULL};
+		execvp(args[0], (char *const *)args);
+
+		// Quiet on purpose: the parent falls back to per-render spawning
+		_exit(EXIT_FAILURE);
+	}
+
+	close(stdin_pipe[0]);
+	close(stdout_pipe[1]);
+	cp->to_child = stdin_pipe[1];
+	cp->from_child = stdout_pipe[0];
+	fcntl(cp->to_child, F_SETFL, O_NONBLOCK);  // For pipe_exchange()
+	return 1;
+}
+
+// Send one framed render request to the coprocess and append its response to
+// out. Returns 1 on success, 0 if the child is gone or the protocol broke;
+// the caller should coproc_stop() it.
+static int coproc_render(coproc_t *cp, const char *input_data,
+                         size_t input_len, buffer_t *out, tee_t *sink) {
+	unsigned char header[FRAME_HEADER_SIZE];
+
+	if (input_len > UINT32_MAX) {
+		fprintf(stderr, "Render request too large for coprocess frame.\n");
+		return 0;
+	}
+
+	frame_header(header, input_len);
+
+	struct iovec iov[2] = {{header, sizeof(header)},
+	                       {(void *)input_data, input_len}};
+	return pipe_exchange(cp->to_child, iov, 2, cp->from_child, out, 1, sink);
+}
+
+void coproc_stop(coproc_t *cp) {
+	if (cp->pid <= 0) return;
+	close(cp->to_child);
+	close(cp->from_child);
+	waitpid(cp->pid, NULL, 0);
+	cp->pid = 0;
+}
+
+int render_markdown(coproc_t *cp, int *use_coproc, const char *input_data,
+                    size_t input_len, buffer_t *out, tee_t *sink) {
+	if (*use_coproc) {
+		size_t start = out->len;
+		size_t teed = sink ? sink->copied : 0;
+		if (coproc_render(cp, input_data, input_len, out, sink)) return 1;
+		out->len = start;  // Drop a partial response
+		// Part of it may already be on stdout: the fallback renders the same
+		// bytes again, so only keep the ones tee() didn't send
+		if (sink && sink->copied != teed) sink = NULL;
+		fprintf(stderr,
+		        "Warning: highlighter coprocess unavailable, spawning "
+		        "'%s' per render instead.\n",
+		        backend.name);
+		coproc_stop(cp);
+		*use_coproc = 0;
+	}
+	return run_pygmentize(input_data, input_len, out, sink);
+}
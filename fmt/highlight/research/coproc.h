@@ -0,0 +1,53 @@
+#ifndef HL_COPROC_H
+#define HL_COPROC_H
+
+#include <stddef.h>  // For size_t
+#include <sys/types.h>
+
+#include "buffer.h"
+#include "io.h"
+
+// Highlighter children: one process per render, or a long-lived coprocess
+// speaking the framed protocol in coproc.py (a 4-byte big-endian length,
+// then that many bytes, each way). The script is looked up next to the
+// driver executable unless HLMD_COPROC is set.
+
+#define COPROC_SCRIPT "coproc.py"
+#define FRAME_HEADER_SIZE 4
+
+typedef struct {
+	pid_t pid;
+	int to_child;    // Write end, connected to the child's stdin
+	int from_child;  // Read end, connected to the child's stdout
+} coproc_t;
+
+// Resolve the coprocess script: $HLMD_COPROC, else coproc.py in the same
+// directory as this executable
+void coproc_script_path(char *path, size_t size);
+
+// Spawn the long-lived highlighter child
+// Returns 1 on success, 0 on failure. A failed exec is only noticed on the
+// first render, which then reports failure like any other dead child.
+int coproc_start(coproc_t *cp);
+
+// Close the pipes (EOF tells the child to exit) and reap it
+void coproc_stop(coproc_t *cp);
+
+// Run the highlighter on input_data in a process of its own. The output is
+// appended to out and, if sink is given, duplicated into sink->fd as it
+// arrives. Returns 1 on success, 0 on failure.
+int run_pygmentize(const char *input_data, size_t input_len, buffer_t *out,
+                   tee_t *sink);
+
+// Render through the coprocess when it is available, falling back to one
+// highlighter process per call if it dies. Same contract as run_pygmentize().
+int render_markdown(coproc_t *cp, int *use_coproc, const char *input_data,
+                    size_t input_len, buffer_t *out, tee_t *sink);
+
+// Frame header for a payload of len bytes
+void frame_header(unsigned char *header, size_t len);
+
+// Payload length from a frame header
+size_t frame_length(const unsigned char *header);
+
+#endif
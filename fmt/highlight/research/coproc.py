@@ -0,0 +1,192 @@
+#!/usr/bin/env -S uv run --script
+# /// script
+# requires-python = ">=3.11"
+# dependencies = ["pygments>=2.19.1", "rich>=14.0.0"]
+# ///
+
+# Long-lived highlighter child for pygmentize.c / rich.c
+#
+# Instead of paying fork+exec+interpreter startup for every render, the C
+# driver spawns this once and sends one framed request per render:
+#
+#   request:  4-byte big-endian length, then that many bytes of markdown
+#   response: 4-byte big-endian length, then that many bytes of ANSI output
+#
+# usage: coproc.py [--zygote] pygmentize|rich
+#
+# With --zygote, stdin is a Unix socket and nothing is rendered on it: each
+# message carries two fds (a request pipe to read, a response pipe to write)
+# and the zygote forks an already warmed-up worker serving the protocol above
+# on them, replying with the worker's pid as a 4-byte big-endian number.
+# Workers exit when their request pipe closes.
+
+import io
+import os
+import signal
+import socket
+import struct
+import sys
+
+HEADER = struct.Struct(">I")
+
+
+def read_exact(stream, n):
+    """Reads exactly n bytes, or returns None on EOF."""
+    chunks = []
+    while n > 0:
+        chunk = stream.read(n)
+        if not chunk:
+            return None
+        chunks.append(chunk)
+        n -= len(chunk)
+    return b"".join(chunks)
+
+
+def make_pygmentize_renderer():
+    from pygments import highlight
+    from pygments.formatters import (
+        Terminal256Formatter,
+        TerminalFormatter,
+        TerminalTrueColorFormatter,
+    )
+    from pygments.lexers import get_lexer_by_name
+
+    # Same formatter selection as `pygmentize` without -f
+    if os.environ.get("COLORTERM", "") in ("truecolor", "24bit"):
+        formatter = TerminalTrueColorFormatter()
+    elif "256" in os.environ.get("TERM", ""):
+        formatter = Terminal256Formatter()
+    else:
+        formatter = TerminalFormatter()
+    # Keep edge newlines: pygmentize.c renders blocks after a checkpoint
+    # separately and their blank lines must survive
+    lexer = get_lexer_by_name("markdown", stripnl=False)
+
+    def render(data):
+        return highlight(data.decode("utf-8", "replace"), lexer, formatter).encode(
+            "utf-8"
+        )
+
+    return render
+
+
+def make_rich_renderer():
+    from rich.console import Console
+    from rich.markdown import Markdown
+
+    def render(data):
+        out = io.StringIO()
+        console = Console(file=out, force_terminal=True)
+        console.print(Markdown(data.decode("utf-8", "replace")), end="")
+        return out.getvalue().encode("utf-8")
+
+    return render
+
+
+# Rendered once by a zygote so its workers start with the markdown lexer and
+# the common fence languages already loaded
+WARM_UP = b"""# x
+*a* `b`
+
+```python
+x = 1
+```
+```c
+int x;
+```
+```sh
+echo x
+```
+```json
+{"x": 1}
+```
+"""
+
+
+def serve(render, stdin, stdout):
+    """Answers framed render requests until stdin closes."""
+    while True:
+        header = read_exact(stdin, HEADER.size)
+        if header is None:
+            break  # driver closed the pipe: normal shutdown
+        (length,) = HEADER.unpack(header)
+        data = read_exact(stdin, length)
+        if data is None:
+            print("coproc.py: truncated request", file=sys.stderr)
+            sys.exit(1)
+
+        try:
+            output = render(data)
+        except Exception as e:
+            # Keep the stream framed even if a render fails
+            print(f"coproc.py: render failed: {e}", file=sys.stderr)
+            output = data
+
+        stdout.write(HEADER.pack(len(output)))
+        stdout.write(output)
+        stdout.flush()
+
+
+def zygote(render):
+    """Forks a worker for each pair of pipe fds received on stdin."""
+    render(WARM_UP)
+    control = socket.socket(fileno=os.dup(0))
+    signal.signal(signal.SIGCHLD, signal.SIG_IGN)  # Workers reap themselves
+    while True:
+        try:
+            msg, fds, _, _ = socket.recv_fds(control, 1, 2)
+        except ConnectionResetError:
+            break
+        if not msg:
+            break  # driver closed the socket: normal shutdown
+        if len(fds) != 2:
+            for fd in fds:
+                os.close(fd)
+            continue
+
+        pid = os.fork()
+        if pid == 0:
+            try:
+                control.close()
+                signal.signal(signal.SIGCHLD, signal.SIG_DFL)
+                os.dup2(fds[0], 0)
+                os.dup2(fds[1], 1)
+                for fd in fds:
+                    os.close(fd)
+                stdin = open(0, "rb", closefd=False)
+                stdout = open(1, "wb", closefd=False)
+                serve(render, stdin, stdout)
+            except (BrokenPipeError, KeyboardInterrupt):
+                pass
+            finally:
+                os._exit(0)
+        for fd in fds:
+            os.close(fd)
+        control.sendall(HEADER.pack(pid))
+
+
+def main():
+    args = sys.argv[1:]
+    as_zygote = bool(args) and args[0] == "--zygote"
+    if as_zygote:
+        args = args[1:]
+    backend = args[0] if args else "pygmentize"
+    if backend == "pygmentize":
+        render = make_pygmentize_renderer()
+    elif backend == "rich":
+        render = make_rich_renderer()
+    else:
+        print(f"coproc.py: unknown backend '{backend}'", file=sys.stderr)
+        sys.exit(1)
+
+    if as_zygote:
+        zygote(render)
+    else:
+        serve(render, sys.stdin.buffer, sys.stdout.buffer)
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except (BrokenPipeError, KeyboardInterrupt):
+        sys.exit(0)
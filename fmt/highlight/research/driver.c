@@ -0,0 +1,365 @@
+#define _POSIX_C_SOURCE 200809L
+#include "driver.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "backend.h"
+#include "stats.h"
+#include "term.h"
+
+const char *input_at(driver_t *d, size_t pos) {
+	return d->input_buf.data + (pos - d->input_base);
+}
+
+size_t input_end(driver_t *d) { return d->input_base + d->input_buf.len; }
+
+job_t *job_at(driver_t *d, int i) {
+	return &d->jobs[(d->job_head + i) % MAX_WORKERS];
+}
+
+void drop_first_line(buffer_t *out, size_t from) {
+	char *nl = memchr(out->data + from, '\n', out->len - from);
+	size_t cut = nl ? (size_t)(nl - out->data) + 1 - from : out->len - from;
+	memmove(out->data + from, out->data + from + cut, out->len - from - cut);
+	out->len -= cut;
+}
+
+void drop_last_line(buffer_t *out, size_t from) {
+	size_t cut = out->len > from ? out->len - 1 : from;
+	while (cut > from && out->data[cut - 1] != '\n') cut--;
+	out->len = cut;
+}
+
+// Length of the provisional close for a render of input[..., end) that
+// stops inside a fence: it has to start on a line of its own
+static size_t provisional_close_len(driver_t *d, size_t end) {
+	return *input_at(d, end - 1) == '\n' ? 4 : 5;
+}
+
+int render_tail(driver_t *d, size_t start, size_t end, buffer_t *out,
+                const char *reopen, size_t reopen_len, size_t close_len) {
+	size_t out_start = out->len;
+	const char *data = input_at(d, start);
+	size_t len = end - start;
+	if (reopen_len || close_len) {
+		const char *close = PROVISIONAL_CLOSE + 5 - close_len;
+		buffer_reset(&d->scratch);
+		if (!buffer_append(&d->scratch, reopen, reopen_len) ||
+		    !buffer_append(&d->scratch, data, len) ||
+		    !buffer_append(&d->scratch, close, close_len)) {
+			return 0;
+		}
+		data = d->scratch.data;
+		len = d->scratch.len;
+	}
+	stats.renders++;
+	stats.input_bytes += len;
+	if (!render_markdown(&d->coproc, &d->use_coproc, data, len, out,
+	                     d->tee.fd >= 0 ? &d->tee : NULL)) {
+		fprintf(stderr, "Error running %s.\n", backend.name);
+		return 0;
+	}
+	if (reopen_len) drop_first_line(out, out_start);
+	if (close_len) drop_last_line(out, out_start);
+	stats.output_bytes += out->len - out_start;
+	return 1;
+}
+
+size_t update_end(driver_t *d, int at_eof, size_t *render_end) {
+	size_t end = input_end(d);
+	if (!at_eof) {
+		while (end > d->scanned && *input_at(d, end - 1) != '\n') end--;
+	}
+	*render_end = end;
+	if (d->partial && !at_eof) {
+		*render_end = end + utf8_safe_end(input_at(d, end), 0,
+		                                  input_end(d) - end);
+	}
+	return end;
+}
+
+// Feed the lines from the block scan up to end to block_boundary(), and
+// return the end of the last block among them (the first with first_only,
+// where the scan stops then), 0 if none ended
+static size_t scan_blocks(driver_t *d, size_t end, int first_only) {
+	size_t boundary = 0;
+	while (d->scanned < end) {
+		size_t pos = d->scanned;
+		const char *line = input_at(d, pos);
+		const char *nl = memchr(line, '\n', end - pos);
+		size_t len = nl ? (size_t)(nl - line) + 1 : end - pos;
+		int in_fence = d->blocks.in_fence;
+		int ended = block_boundary(&d->blocks, line, len);
+		if (d->blocks.in_fence && !in_fence) {
+			int fits = len <= REOPEN_MAX && line[len - 1] == '\n';
+			if (fits) memcpy(d->fence_line, line, len);
+			d->fence_line_len = fits ? len : 0;
+			d->fence_start = pos;
+		}
+		d->scanned = pos + len;
+		if (ended) {
+			boundary = d->scanned;
+			if (first_only) break;
+		}
+	}
+	return boundary;
+}
+
+int plan_update(driver_t *d, int at_eof, update_t *u) {
+	size_t render_end;
+	size_t end = update_end(d, at_eof, &render_end);
+	if (render_end == d->rendered_end && !d->redraw) return 0;
+	d->rendered_end = render_end;
+	u->redraw = d->redraw;
+	d->redraw = 0;
+	u->new_input = render_end - d->scanned;
+
+	// Blocks are cut at the smaller of --max-window and the budget's limit
+	size_t window = d->max_window;
+	if (d->window_limit && (!window || d->window_limit < window)) {
+		window = d->window_limit;
+	}
+
+	// Find the last block boundary among the new lines
+	size_t boundary = scan_blocks(d, end, 0);
+
+	// Everything up to that boundary can never render differently again:
+	// it is rendered once, committed, and the next tail starts after it
+	u->start = d->checkpoint;
+	u->reopen_start = d->checkpoint_reopen;
+	if (boundary > d->checkpoint) {
+		d->checkpoint = boundary;
+		d->checkpoint_reopen = 0;  // Blocks only end outside fences
+	} else if (window && end > d->checkpoint &&
+	           end - d->checkpoint > window &&
+	           (!d->blocks.in_fence || d->fence_line_len)) {
+		// A block that outgrew the window is cut at its last complete line.
+		// No block ended since the checkpoint, so a fence open there is the
+		// same one and reopen stays valid for the commit render too. The
+		// code lexer restarts at the cut, like at a fresh fence.
+		d->checkpoint = end;
+		d->checkpoint_reopen = d->blocks.in_fence;
+		if (d->checkpoint_reopen) {
+			memcpy(d->reopen, d->fence_line, d->fence_line_len);
+			d->reopen_len = d->fence_line_len;
+		}
+	}
+	u->boundary = d->checkpoint;
+	u->reopen_boundary = d->checkpoint_reopen;
+	u->end = end;
+	u->render_end = render_end;
+
+	// A fence still open is assumed to close: its code so far is shown as
+	// code, and the closing line only appends to it. At EOF the render is
+	// left as the highlighter sees it.
+	u->close_boundary = u->close_end = u->fence = 0;
+	if (backend.closes_fences) {
+		if (u->reopen_boundary && u->boundary > u->start) {
+			u->close_boundary = provisional_close_len(d, u->boundary);
+		}
+		if (d->blocks.in_fence && !at_eof && render_end > u->boundary) {
+			u->close_end = provisional_close_len(d, render_end);
+			u->fence = d->fence_start + 1;
+		}
+	}
+	return 1;
+}
+
+void trim_provisional(size_t end, size_t render_end, buffer_t *out,
+                      size_t commit_len) {
+	if (render_end > end && out->len > commit_len &&
+	    out->data[out->len - 1] == '\n') {
+		out->len--;
+	}
+}
+
+// When none of the window is on screen yet, all of it is new output: with
+// stdout a pipe it can go there in-kernel as the child produces it. A
+// provisional line may lose its trailing newline, so never with partial,
+// and a reopened or provisionally closed render drops a line, so not for
+// those either.
+int can_tee(driver_t *d, const update_t *u) {
+	return d->stdout_fifo && !d->partial && !u->reopen_start &&
+	       !u->reopen_boundary && !u->close_boundary && !u->close_end &&
+	       (d->first_run || d->shown.len == 0);
+}
+
+// Free the input no render needs again: before the checkpoint and before
+// every job in flight, which pool_fail() may have to render again. Only
+// moves the rest down once at least as much is free, so each byte is
+// moved about once.
+void input_release(driver_t *d) {
+	size_t keep = d->checkpoint;
+	for (int i = 0; i < d->job_count; i++) {
+		job_t *job = job_at(d, i);
+		if (!job->done && job->start < keep) keep = job->start;
+	}
+	size_t dead = keep - d->input_base;
+	size_t live = d->input_buf.len - dead;
+	if (dead < RELEASE_MIN || dead < live) return;
+	memmove(d->input_buf.data, d->input_buf.data + dead, live);
+	d->input_buf.len = live;
+	d->input_base = keep;
+	buffer_shrink(&d->input_buf);
+}
+
+// Fit the next renders into the latency budget, now that one took ms for
+// bytes of input. An update renders about a window, so a slow render cuts
+// the window down to what would have fit, and a fast one of nearly a whole
+// window lets it grow back. When renders are slow even with the smallest
+// window, the cost is the highlighter's own overhead: the rest of the block
+// is shown plain, and the next block gets rendered and measured again.
+void budget_account(driver_t *d, long long ms, size_t bytes) {
+	if (d->budget_ms <= 0) return;
+	if (ms > d->budget_ms) {
+		int smallest = d->window_limit == WINDOW_MIN;
+		size_t fit = (size_t)((double)bytes * d->budget_ms / ms * 0.75);
+		d->window_limit = fit > WINDOW_MIN ? fit : WINDOW_MIN;
+		if (smallest && ++d->slow_renders >= SLOW_RENDERS) d->plain = 1;
+	} else {
+		d->slow_renders = 0;
+		if (d->window_limit && ms * 2 < d->budget_ms &&
+		    bytes * 2 >= d->window_limit) {
+			size_t max = d->max_window ? d->max_window : DEFAULT_MAX_WINDOW;
+			d->window_limit *= 2;
+			if (d->window_limit >= max) d->window_limit = 0;
+		}
+	}
+}
+
+// Write the input as it arrives, unhighlighted, until the block ends (see
+// budget_account()). What is on screen stays: the plain text goes on from
+// the end of the last render, which is committed as shown. Updates after
+// the block are rendered again.
+// Returns 1 on success, 0 on failure
+static int plain_update(driver_t *d, int at_eof) {
+	if (d->job_count > 0) {
+		d->dirty = 1;  // Shown first, then pool_handle() comes back here
+		return 1;
+	}
+	d->dirty = 0;
+	if (!frame_tick(d, 1)) return 0;
+	d->committed_len += d->shown.len;
+	shown_truncate(&d->shown, 0);
+	d->shown_fence = 0;
+
+	size_t render_end;
+	size_t end = update_end(d, at_eof, &render_end);
+	size_t boundary = scan_blocks(d, end, 1);
+	size_t to = boundary ? boundary : render_end;
+	if (to > d->rendered_end) {
+		stats.branch = "plain";
+		if (!write_output(d, input_at(d, d->rendered_end),
+		                  to - d->rendered_end)) {
+			perror("Failed to write plain output");
+			return 0;
+		}
+		stats_record(0);
+		d->rendered_end = to;
+	}
+	d->checkpoint = boundary ? boundary : end;
+	d->checkpoint_reopen = 0;
+	if (!boundary) return 1;
+	d->plain = 0;
+	return driver_update(d, at_eof);  // For what came after the block
+}
+
+int driver_update(driver_t *d, int at_eof) {
+	if (d->plain) return plain_update(d, at_eof);
+	if (d->pool.zygote >= 0) return pool_update(d, at_eof);
+
+	update_t u;
+	if (!plan_update(d, at_eof, &u)) return 1;  // Nothing new to show
+
+	// Build the new uncommitted window in current_output. The highlighter
+	// usually expands input a few times over, so reserve for that up front;
+	// after a few updates the pooled capacity covers it without reallocs.
+	buffer_t *cur = &d->current_output;
+	buffer_reset(cur);
+	if (!buffer_reserve(cur,
+	                    d->shown.len + OUTPUT_EXPANSION * u.new_input)) {
+		return 0;
+	}
+
+	int teeing = can_tee(d, &u);
+	d->tee.fd = teeing ? STDOUT_FILENO : -1;
+	d->tee.copied = 0;
+
+	long long started = now_ms();
+	size_t commit_len = 0;
+	size_t reopen_len = u.reopen_start ? d->reopen_len : 0;
+	if (u.boundary > u.start) {
+		if (!render_tail(d, u.start, u.boundary, cur, d->reopen, reopen_len,
+		                 u.close_boundary)) {
+			return 0;
+		}
+		commit_len = cur->len;
+	}
+	reopen_len = u.reopen_boundary ? d->reopen_len : 0;
+	if (u.render_end > u.boundary) {
+		if (!render_tail(d, u.boundary, u.render_end, cur, d->reopen,
+		                 reopen_len, u.close_end)) {
+			return 0;
+		}
+		trim_provisional(u.end, u.render_end, cur, commit_len);
+	}
+	budget_account(d, now_ms() - started, u.render_end - u.start);
+
+	if (teeing && d->tee.fd < 0) d->stdout_fifo = 0;  // tee() unsupported
+
+	d->window_fence = u.fence;
+	d->window_redraw = u.redraw;
+	if (!frame_submit(d, commit_len)) return 0;
+	stats_record(commit_len);
+	return 1;
+}
+
+int driver_finish(driver_t *d) {
+	if (!driver_update(d, 1)) return 0;
+	while (d->pool.zygote >= 0 && (d->dirty || d->job_count > 0)) {
+		struct pollfd fds[2 * MAX_WORKERS];
+		int nfds = pool_pollfds(d, fds);
+		int ready = poll(fds, nfds, frame_timeout(d));
+		if (ready == -1 && errno != EINTR) {
+			perror("poll on workers failed");
+			return 0;
+		}
+		if (ready > 0 && !pool_handle(d, fds, nfds, 1)) return 0;
+		if (!frame_tick(d, 0)) return 0;
+	}
+	return frame_tick(d, 1);
+}
+
+void driver_init(driver_t *d, int workers) {
+	buffer_init(&d->input_buf);
+	buffer_init(&d->current_output);
+	buffer_init(&d->frame);
+	buffer_init(&d->scratch);
+	d->first_run = 1;
+#ifdef __linux__
+	struct stat st;
+	d->stdout_fifo = fstat(STDOUT_FILENO, &st) == 0 && S_ISFIFO(st.st_mode);
+#endif
+	d->tee.fd = -1;
+	long long spawn = stats_clock();  // Counted in the first update
+	if (!pool_start(&d->pool, workers)) {
+		d->use_coproc = coproc_start(&d->coproc);
+	}
+	stats_since(&stats.spawn_us, spawn);
+}
+
+void driver_free(driver_t *d) {
+	pool_stop(&d->pool);
+	for (int i = 0; i < MAX_WORKERS; i++) buffer_free(&d->jobs[i].out);
+	coproc_stop(&d->coproc);
+	buffer_free(&d->input_buf);
+	shown_free(&d->shown);
+	buffer_free(&d->current_output);
+	buffer_free(&d->frame);
+	buffer_free(&d->scratch);
+}
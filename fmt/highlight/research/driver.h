@@ -0,0 +1,272 @@
+#ifndef HL_DRIVER_H
+#define HL_DRIVER_H
+
+#include <poll.h>
+#include <stddef.h>  // For size_t
+
+#include "blocks.h"
+#include "buffer.h"
+#include "coproc.h"
+#include "io.h"
+#include "pool.h"
+#include "shown.h"
+
+// The streaming driver: markdown arrives on stdin a few bytes at a time and
+// is re-highlighted from the last block that can't change anymore, and only
+// what differs from the screen is written. driver.c plans and renders
+// updates, screen.c puts them on the terminal, jobs.c runs them on the
+// worker pool.
+
+// Rough output bytes per input byte, for reserving render buffers
+#define OUTPUT_EXPANSION 4
+
+// A block still open after this much input is committed at its last
+// complete line anyway, so memory stays bounded however long it gets
+#define DEFAULT_MAX_WINDOW (1 << 20)
+// Longest fence opener that is kept for reopening a fence after such a cut
+#define REOPEN_MAX 256
+// Provisional close: its last 4 bytes after a complete line, all of it after
+// an unfinished one
+#define PROVISIONAL_CLOSE "\n```\n"
+
+// Latency budget for one update's renders (see budget_account()). A slower
+// render makes blocks get cut sooner, down to WINDOW_MIN; once SLOW_RENDERS
+// renders of at most that much input in a row are over it, the rest of the
+// block is shown as plain text.
+#define DEFAULT_BUDGET_MS 100
+#define WINDOW_MIN (4 * 1024)
+#define SLOW_RENDERS 3
+
+// One pipelined update in flight on a worker: the commit render and/or the
+// tail render (see update_t), sent as one or two framed requests. Input is
+// referenced by offset because input_buf may move while the request is
+// still being written.
+typedef struct {
+	int worker;
+	size_t start, boundary, end, render_end;  // As in update_t
+	int frames;                               // Requests: commit, tail
+	int reopens[2];  // The request starts inside a fence (see plan_update())
+	size_t closes[2];  // Provisional close it ends with, 0 if none
+	size_t fence;      // As update_t's
+	char reopen[REOPEN_MAX];
+	size_t reopen_len;
+	unsigned char headers[2][FRAME_HEADER_SIZE];
+	size_t request_len;
+	size_t sent;
+
+	buffer_t out;  // Responses, back to back, kept across jobs in the slot
+	int frames_done;
+	unsigned char header[FRAME_HEADER_SIZE];
+	size_t header_got;
+	size_t frame_start;  // Where the current response starts in out
+	size_t want;         // Its length, once the header is in
+	size_t commit_len;   // Output of the commit render
+	tee_t tee;
+	int tee_unsupported;
+	int done;
+
+	long long dispatched_us, sent_us, done_us;  // For stats
+	long long dispatched_ms;                    // For the latency budget
+	int redraw;                                 // As update_t's
+} job_t;
+
+// Everything the main loop carries from one render to the next
+typedef struct {
+	coproc_t coproc;
+	int use_coproc;
+
+	// Input offsets are absolute, counted from the start of the stream.
+	// input_buf holds the input from input_base on: what comes before the
+	// checkpoint (and every render still in flight) is freed, see
+	// input_release().
+	buffer_t input_buf;
+	size_t input_base;
+	size_t scanned;  // Input before this has been fed to block_boundary()
+
+	// Input before checkpoint has been rendered, written and committed for
+	// good: its committed_len output bytes are never compared or kept again
+	block_state_t blocks;
+	size_t checkpoint;
+	size_t committed_len;
+
+	// A window over max_window bytes is cut at its last complete line. If
+	// that is inside a fence, renders from the checkpoint start with the
+	// fence's opener line (reopen) and drop its output line.
+	size_t max_window;
+	char fence_line[REOPEN_MAX];  // Opener of the fence being scanned
+	size_t fence_line_len;        // 0 if too long to reopen
+	size_t fence_start;           // Its input offset
+	char reopen[REOPEN_MAX];
+	size_t reopen_len;
+	int checkpoint_reopen;
+	buffer_t scratch;  // Reopened render input
+
+	// Latency budget (see budget_account()): the window is cut at
+	// window_limit bytes as well, when that is set and smaller
+	long long budget_ms;
+	size_t window_limit;
+	int slow_renders;  // Small renders in a row that went over the budget
+	int plain;         // The rest of the block is shown unhighlighted
+
+	// Uncommitted window. shown describes what has been written to stdout
+	// after the committed output (the last tail render), line by line;
+	// current_output is where the next one is built, compared against
+	// shown, written and then indexed into it. Only the render in progress
+	// is ever kept whole, and its buffer is reused, so once it has grown to
+	// the window size renders allocate nothing.
+	shown_t shown;
+	buffer_t current_output;
+	int first_run;
+	// Which fence each of them closes provisionally (see update_t), to
+	// count the ones that closed without a repaint
+	size_t shown_fence;
+	size_t window_fence;
+	// After a resize the window is rendered again and drawn whole (see
+	// emit_output()): requested, and set on the render that does it
+	int redraw;
+	int window_redraw;
+
+	// Output goes to a terminal, so the cursor can be moved to repaint
+	int tty;
+	// Output goes to a pipe, so new output can be tee()d from the child
+	int stdout_fifo;
+	tee_t tee;
+	// Show the unfinished last line before its newline arrives (tty only)
+	int partial;
+	size_t rendered_end;  // Input covered by shown
+
+	// Frame scheduler (tty only, frame_ms > 0). An update's window is held
+	// in frame until a frame is due; a newer update replaces it, keeping the
+	// commit renders in front (frame_commit bytes) that are not shown yet.
+	long long frame_ms;
+	long long last_frame;  // now_ms() when the last frame was shown
+	buffer_t frame;
+	size_t frame_commit;
+	size_t frame_fence;
+	int frame_redraw;
+	int frame_held;
+	int sync_output;  // Wrap frames in SYNC_BEGIN/SYNC_END
+
+	// Pipelined renders, oldest first. Results are shown in order, except
+	// that a finished tail render is skipped once a newer one has finished.
+	pool_t pool;
+	job_t jobs[MAX_WORKERS];
+	int job_head;
+	int job_count;
+	int dirty;  // An update was due while every worker was busy
+} driver_t;
+
+// What one update shows: input[start, boundary) rendered once and committed
+// (when boundary > start), then input[boundary, render_end) as the new
+// uncommitted window. Input past end is a provisional unfinished line.
+typedef struct {
+	size_t start, boundary, end, render_end;
+	int reopen_start, reopen_boundary;  // Renders from there reopen a fence
+	int redraw;  // Drawn whole, see emit_output()
+	// Renders up to there stop inside a fence: provisional close lengths
+	// (see render_tail()), and the fence's input offset + 1 for the tail
+	size_t close_boundary, close_end;
+	size_t fence;
+	size_t new_input;  // Input that wasn't in any earlier update
+} update_t;
+
+// Where input offset pos is in input_buf
+const char *input_at(driver_t *d, size_t pos);
+
+// Input offset just past everything received
+size_t input_end(driver_t *d);
+
+// The i-th pipelined job in flight, oldest first
+job_t *job_at(driver_t *d, int i);
+
+// Ready a zeroed d for a stream to stdout and start its highlighter: a pool
+// of workers, else one coprocess, else a process per render. The options
+// (tty, partial, frame_ms, ...) are the caller's to set.
+void driver_init(driver_t *d, int workers);
+
+void driver_free(driver_t *d);
+
+// driver.c
+
+// Render the next update and show it (see plan_update())
+// Returns 1 on success, 0 on failure
+int driver_update(driver_t *d, int at_eof);
+
+// Render what is left at EOF and wait for every job to be shown
+// Returns 1 on success, 0 on failure
+int driver_finish(driver_t *d);
+
+// Plan the next update over everything received up to the last complete
+// line (or all of it at EOF), however many lines arrived since the last
+// one, and move the block scan and the checkpoint past it.
+// Returns 0 if there is nothing new to show
+int plan_update(driver_t *d, int at_eof, update_t *u);
+
+// End of the complete lines, and of what the next update would render
+size_t update_end(driver_t *d, int at_eof, size_t *render_end);
+
+// Render input[start, end) on its own, appending to out. With reopen, it
+// continues a fence that opened before start (see plan_update()), and with
+// close_len it ends with that much of PROVISIONAL_CLOSE.
+// Returns 1 on success, 0 on failure
+int render_tail(driver_t *d, size_t start, size_t end, buffer_t *out,
+                const char *reopen, size_t reopen_len, size_t close_len);
+
+// Remove the first output line appended after from: the rendered fence
+// opener in front of a reopened render
+void drop_first_line(buffer_t *out, size_t from);
+
+// Drop the last line of out[from, len), which ends with a newline
+void drop_last_line(buffer_t *out, size_t from);
+
+// The highlighter terminates a provisional line with a newline we must not
+// show yet: the rest of the line still has to go there
+void trim_provisional(size_t end, size_t render_end, buffer_t *out,
+                      size_t commit_len);
+
+// Whether an update's output can be tee()d to stdout (see driver.c)
+int can_tee(driver_t *d, const update_t *u);
+
+// Free the input no render needs again (see driver.c)
+void input_release(driver_t *d);
+
+// Fit the next renders into the latency budget, now that one took ms for
+// bytes of input (see driver.c)
+void budget_account(driver_t *d, long long ms, size_t bytes);
+
+// screen.c
+
+// Show the update in current_output, whose first commit_len bytes are
+// committed, or hold it until the next frame is due.
+// Returns 1 on success, 0 on failure
+int frame_submit(driver_t *d, size_t commit_len);
+
+// Show the held frame if it is due (or now, with force), outside an update
+// Returns 1 on success, 0 if writing it failed
+int frame_tick(driver_t *d, int force);
+
+// Milliseconds until the held frame is due, -1 if there is none
+int frame_timeout(driver_t *d);
+
+// The sooner of two poll() timeouts, -1 meaning none
+int min_timeout(int a, int b);
+
+// Write output as one frame. Returns 1 on success, 0 on failure
+int write_output(driver_t *d, const char *data, size_t len);
+
+// jobs.c
+
+// Dispatch the next update to an idle worker. With all of them busy the
+// update waits (d->dirty) and picks up whatever arrived by then.
+// Returns 1 on success, 0 on failure
+int pool_update(driver_t *d, int at_eof);
+
+// poll() entries for the jobs in flight, returns how many were added
+int pool_pollfds(driver_t *d, struct pollfd *fds);
+
+// Handle poll() results from pool_pollfds(), show what finished and
+// dispatch an update that was waiting for a worker
+// Returns 1 on success, 0 on failure
+int pool_handle(driver_t *d, struct pollfd *fds, int nfds, int at_eof);
+
+#endif
@@ -0,0 +1,86 @@
+#include "hash.h"
+
+#include <string.h>
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+static void sip_round(uint64_t *v) {
+	v[0] += v[1];
+	v[1] = ROTL(v[1], 13) ^ v[0];
+	v[0] = ROTL(v[0], 32);
+	v[2] += v[3];
+	v[3] = ROTL(v[3], 16) ^ v[2];
+	v[0] += v[3];
+	v[3] = ROTL(v[3], 21) ^ v[0];
+	v[2] += v[1];
+	v[1] = ROTL(v[1], 17) ^ v[2];
+	v[2] = ROTL(v[2], 32);
+}
+
+static void sip_compress(uint64_t *v, uint64_t m) {
+	v[3] ^= m;
+	sip_round(v);
+	sip_round(v);
+	v[0] ^= m;
+}
+
+// Words are read little-endian, as the reference implementation does
+static uint64_t load_le64(const char *p) {
+	uint64_t w;
+	memcpy(&w, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	w = __builtin_bswap64(w);
+#endif
+	return w;
+}
+
+void hash_init(hash_state_t *h) {
+	const uint64_t k0 = 0x243F6A8885A308D3ULL, k1 = 0x13198A2E03707344ULL;
+	h->v[0] = k0 ^ 0x736F6D6570736575ULL;
+	h->v[1] = k1 ^ 0x646F72616E646F6DULL ^ 0xEE;  // 128-bit output
+	h->v[2] = k0 ^ 0x6C7967656E657261ULL;
+	h->v[3] = k1 ^ 0x7465646279746573ULL;
+	h->tail = 0;
+	h->len = 0;
+}
+
+void hash_update(hash_state_t *h, const char *data, size_t len) {
+	size_t i = 0;
+	for (; i < len && (h->len & 7); i++, h->len++) {
+		h->tail |= (uint64_t)(unsigned char)data[i] << (8 * (h->len & 7));
+		if ((h->len & 7) == 7) {
+			sip_compress(h->v, h->tail);
+			h->tail = 0;
+		}
+	}
+	for (; i + 8 <= len; i += 8, h->len += 8) {
+		sip_compress(h->v, load_le64(data + i));
+	}
+	for (; i < len; i++, h->len++) {
+		h->tail |= (uint64_t)(unsigned char)data[i] << (8 * (h->len & 7));
+	}
+}
+
+void hash_word(hash_state_t *h, uint64_t w) {
+	char bytes[8];
+	for (int i = 0; i < 8; i++) bytes[i] = (char)(w >> (8 * i));
+	hash_update(h, bytes, 8);
+}
+
+void hash_string(hash_state_t *h, const char *s) {
+	size_t len = s ? strlen(s) : 0;
+	hash_update(h, s ? s : "", len);
+	hash_word(h, len);
+}
+
+hash128_t hash_final(const hash_state_t *h) {
+	uint64_t v[4] = {h->v[0], h->v[1], h->v[2], h->v[3]};
+	sip_compress(v, (uint64_t)h->len << 56 | h->tail);
+	v[2] ^= 0xEE;
+	for (int i = 0; i < 4; i++) sip_round(v);
+	hash128_t out = {.a = v[0] ^ v[1] ^ v[2] ^ v[3]};
+	v[1] ^= 0xDD;
+	for (int i = 0; i < 4; i++) sip_round(v);
+	out.b = v[0] ^ v[1] ^ v[2] ^ v[3];
+	return out;
+}
@@ -0,0 +1,35 @@
+#ifndef HL_HASH_H
+#define HL_HASH_H
+
+#include <stddef.h>  // For size_t
+#include <stdint.h>
+
+// SipHash-2-4 with its 128-bit output (Aumasson and Bernstein), fed
+// incrementally. The key is a constant: this guards against inputs that
+// collide by accident, for which 128 bits leave a 2^64 birthday bound, not
+// against anyone who sets out to make them collide
+
+typedef struct {
+	uint64_t a, b;
+} hash128_t;
+
+typedef struct {
+	uint64_t v[4];
+	uint64_t tail;  // Bytes of the word not complete yet
+	size_t len;     // Bytes fed so far
+} hash_state_t;
+
+void hash_init(hash_state_t *h);
+
+void hash_update(hash_state_t *h, const char *data, size_t len);
+
+// A number as its 8 bytes
+void hash_word(hash_state_t *h, uint64_t w);
+
+// A string followed by its length, so "ab" + "c" stays apart from "a" + "bc"
+void hash_string(hash_state_t *h, const char *s);
+
+// The hash of everything fed so far; h can be fed more after
+hash128_t hash_final(const hash_state_t *h);
+
+#endif
@@ -0,0 +1,49 @@
+#include "io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+void iov_advance(struct iovec **iov, int *iovcnt, size_t n) {
+	while (*iovcnt > 0 && n >= (*iov)->iov_len) {
+		n -= (*iov)->iov_len;
+		(*iov)++;
+		(*iovcnt)--;
+	}
+	if (*iovcnt > 0) {
+		(*iov)->iov_base = (char *)(*iov)->iov_base + n;
+		(*iov)->iov_len -= n;
+	}
+}
+
+int writev_all(int fd, struct iovec *iov, int iovcnt) {
+	while (iovcnt > 0) {
+		ssize_t n = writev(fd, iov, iovcnt);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return 0;
+		}
+		iov_advance(&iov, &iovcnt, n);
+	}
+	return 1;
+}
+
+int write_all(int fd, const char *data, size_t len) {
+	struct iovec iov = {.iov_base = (char *)data, .iov_len = len};
+	return writev_all(fd, &iov, 1);
+}
+
+int write_stdout(const char *data, size_t len) {
+	long long t = stats_clock();
+	int ok = write_all(STDOUT_FILENO, data, len);
+	stats_since(&stats.stdout_us, t);
+	stats.stdout_bytes += len;
+	return ok;
+}
+
+void set_cloexec_nonblock(int fd, int nonblock) {
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	if (nonblock) fcntl(fd, F_SETFL, O_NONBLOCK);
+}
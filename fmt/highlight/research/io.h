@@ -0,0 +1,32 @@
+#ifndef HL_IO_H
+#define HL_IO_H
+
+#include <stddef.h>  // For size_t
+#include <sys/uio.h>
+
+// Rendered bytes that are known to be new output can go to stdout in-kernel
+// as they arrive from the child (Linux tee()) instead of via write() later
+typedef struct {
+	int fd;         // Pipe to duplicate the child's output into, -1 for none
+	size_t copied;  // Bytes duplicated so far
+} tee_t;
+
+// Drop the first n written bytes from an iovec array
+void iov_advance(struct iovec **iov, int *iovcnt, size_t n);
+
+// Write an iovec array completely, retrying partial writes
+// Returns 1 on success, 0 on failure
+int writev_all(int fd, struct iovec *iov, int iovcnt);
+
+// Write a buffer completely, retrying partial writes
+// Returns 1 on success, 0 on failure
+int write_all(int fd, const char *data, size_t len);
+
+// write_all() to stdout, counted for stats
+int write_stdout(const char *data, size_t len);
+
+// Our ends of child pipes must not leak into other children, or a child
+// would not see EOF when we close its request pipe
+void set_cloexec_nonblock(int fd, int nonblock);
+
+#endif
@@ -0,0 +1,369 @@
+#define _GNU_SOURCE  // For tee(), only used on Linux
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "backend.h"
+#include "driver.h"
+#include "stats.h"
+
+// Pipelined renders on the worker pool (see pool.h): each update is a job
+// on an idle worker, shown in order as it finishes, and a job newer input
+// made pointless is dropped or killed
+
+// Input range of a job's request f; its reopen prefix is job->reopens[f]
+static void job_frame(const job_t *job, int f, size_t *off, size_t *len) {
+	int commit = job->boundary > job->start;
+	if (f == 0 && commit) {
+		*off = job->start;
+		*len = job->boundary - job->start;
+	} else {
+		*off = job->boundary;
+		*len = job->render_end - job->boundary;
+	}
+}
+
+// Write as much of a job's requests as the pipe takes
+// Returns 1 on success (including a full pipe), 0 if the worker is gone
+static int job_send(driver_t *d, job_t *job) {
+	worker_t *w = &d->pool.workers[job->worker];
+	while (job->sent < job->request_len) {
+		struct iovec iov[8];
+		struct iovec *iovp = iov;
+		int iovcnt = 0;
+		for (int f = 0; f < job->frames; f++) {
+			size_t off, len;
+			job_frame(job, f, &off, &len);
+			iov[iovcnt++] = (struct iovec){job->headers[f], FRAME_HEADER_SIZE};
+			if (job->reopens[f]) {
+				iov[iovcnt++] = (struct iovec){job->reopen, job->reopen_len};
+			}
+			iov[iovcnt++] = (struct iovec){(char *)input_at(d, off), len};
+			if (job->closes[f]) {
+				const char *close = PROVISIONAL_CLOSE + 5 - job->closes[f];
+				iov[iovcnt++] = (struct iovec){(char *)close, job->closes[f]};
+			}
+		}
+		iov_advance(&iovp, &iovcnt, job->sent);
+		ssize_t n = writev(w->to_child, iovp, iovcnt);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN) return 1;
+			if (errno != EPIPE) perror("write to worker failed");
+			return 0;
+		}
+		job->sent += n;
+	}
+	if (!job->sent_us) job->sent_us = stats_clock();
+	return 1;
+}
+
+// Read whatever responses the worker has ready. Returns 1 on success
+// (including nothing to read yet), 0 if the worker died or I/O failed
+static int job_receive(driver_t *d, job_t *job) {
+	worker_t *w = &d->pool.workers[job->worker];
+	while (!job->done) {
+		ssize_t n;
+		if (job->header_got < FRAME_HEADER_SIZE) {
+			n = read(w->from_child, job->header + job->header_got,
+			         FRAME_HEADER_SIZE - job->header_got);
+		} else {
+			size_t room = job->want - (job->out.len - job->frame_start);
+			int teed = 0;
+#ifdef __linux__
+			if (job->tee.fd >= 0) {
+				// Same as pipe_exchange(), except a full stdout ends teeing
+				// for this job so what was tee()d stays a prefix
+				ssize_t t = tee(w->from_child, job->tee.fd, room,
+				                SPLICE_F_NONBLOCK);
+				if (t > 0) {
+					room = t;
+					teed = 1;
+				} else if (t < 0 && errno == EINTR) {
+					continue;
+				} else if (t < 0) {
+					if (errno != EAGAIN) job->tee_unsupported = 1;
+					job->tee.fd = -1;
+				}
+			}
+#endif
+			n = read(w->from_child, job->out.data + job->out.len, room);
+			if (n > 0 && teed) {
+				job->tee.copied += n;
+				stats.stdout_bytes += n;
+			}
+		}
+
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN) return 1;
+			perror("read from worker failed");
+			return 0;
+		}
+		if (n == 0) return 0;  // Worker died mid-response
+
+		if (job->header_got < FRAME_HEADER_SIZE) {
+			job->header_got += n;
+			if (job->header_got < FRAME_HEADER_SIZE) continue;
+			unsigned char *h = job->header;
+			job->want = frame_length(h);
+			if (!buffer_reserve(&job->out, job->want)) return 0;
+			job->frame_start = job->out.len;
+		} else {
+			job->out.len += n;
+		}
+
+		if (job->out.len - job->frame_start == job->want) {
+			if (job->reopens[job->frames_done]) {
+				drop_first_line(&job->out, job->frame_start);
+			}
+			if (job->closes[job->frames_done]) {
+				drop_last_line(&job->out, job->frame_start);
+			}
+			job->header_got = 0;
+			job->frames_done++;
+			if (job->frames_done == 1 && job->boundary > job->start) {
+				job->commit_len = job->out.len;
+			}
+			if (job->frames_done == job->frames) {
+				trim_provisional(job->end, job->render_end, &job->out,
+				                 job->commit_len);
+				job->done = 1;
+				job->done_us = stats_clock();
+			}
+		}
+	}
+	return 1;
+}
+
+// A job that neither commits nor has put anything on stdout can be thrown
+// away: the next update renders the same window with more input
+static int job_droppable(job_t *job) {
+	return job->boundary == job->start && job->tee.copied == 0 &&
+	       job->tee.fd < 0;
+}
+
+static void job_release(driver_t *d, job_t *job) {
+	d->pool.workers[job->worker].busy = 0;
+	d->job_head = (d->job_head + 1) % MAX_WORKERS;
+	d->job_count--;
+}
+
+// Show finished jobs in order, skipping ones a finished newer job replaces
+// Returns 1 on success, 0 on failure
+static int pool_emit_ready(driver_t *d) {
+	while (d->job_count > 0 && job_at(d, 0)->done) {
+		job_t *job = job_at(d, 0);
+		int newer_done = 0;
+		for (int i = 1; i < d->job_count; i++) {
+			if (job_at(d, i)->done) newer_done = 1;
+		}
+		if (newer_done && job_droppable(job)) {
+			if (job->redraw) job_at(d, 1)->redraw = 1;
+			stats.dropped++;
+			job_release(d, job);
+			continue;
+		}
+
+		if (job->frames > 0 && job->done_us) {  // Not rerun by pool_fail()
+			stats.renders += job->frames;
+			stats.input_bytes += job->render_end - job->start;
+			stats.output_bytes += job->out.len;
+			stats.write_us += job->sent_us - job->dispatched_us;
+			stats.read_us += job->done_us - job->sent_us;
+		}
+		if (job->tee_unsupported) d->stdout_fifo = 0;
+		if (job->frames > 0) {
+			budget_account(d, now_ms() - job->dispatched_ms,
+			               job->render_end - job->start);
+		}
+
+		// The job's buffer becomes current_output for emit_output(); the
+		// one that comes back (emptied there) stays with the slot
+		buffer_swap(&d->current_output, &job->out);
+		d->tee = job->tee;
+		d->window_fence = job->fence;
+		d->window_redraw = job->redraw;
+		int ok = frame_submit(d, job->commit_len);
+		d->tee.fd = -1;
+		d->tee.copied = 0;
+		buffer_swap(&d->current_output, &job->out);
+		if (!ok) return 0;
+		stats_record(job->commit_len);
+		job_release(d, job);
+	}
+	return 1;
+}
+
+// Render everything still queued one process per render, then turn the
+// pool off for good: the rest of the stream goes through run_pygmentize()
+// Returns 1 on success, 0 on failure
+static int pool_fail(driver_t *d) {
+	fprintf(stderr,
+	        "Warning: highlighter workers unavailable, spawning '%s' per "
+	        "render instead.\n",
+	        backend.name);
+	pool_stop(&d->pool);
+	for (int i = 0; i < d->job_count; i++) {
+		job_t *job = job_at(d, i);
+		if (job->done) continue;
+		// What was tee()d is the start of the same output: keep the count
+		// so it isn't written twice, but don't tee the rerun
+		buffer_reset(&job->out);
+		job->commit_len = 0;
+		int ok = 1;
+		for (int f = 0; f < job->frames && ok; f++) {
+			size_t off, len;
+			job_frame(job, f, &off, &len);
+			ok = render_tail(d, off, off + len, &job->out, job->reopen,
+			                 job->reopens[f] ? job->reopen_len : 0,
+			                 job->closes[f]);
+			if (f == 0 && job->boundary > job->start) {
+				job->commit_len = job->out.len;
+			}
+		}
+		trim_provisional(job->end, job->render_end, &job->out,
+		                 job->commit_len);
+		if (!ok) return 0;
+		job->tee.fd = -1;
+		job->frames = 0;  // Counted by render_tail() already
+		job->done = 1;
+	}
+	return pool_emit_ready(d);
+}
+
+// Kill the newest job to make room for a fresher one; never the oldest, so
+// something always gets shown. Returns its worker, -1 if there is none to
+// cancel, -2 if a replacement worker could not be started
+static int pool_cancel_newest(driver_t *d) {
+	if (d->job_count < 2) return -1;
+	job_t *job = job_at(d, d->job_count - 1);
+	if (!job_droppable(job)) return -1;
+	worker_t *w = &d->pool.workers[job->worker];
+	worker_stop(w, 1);
+	d->job_count--;
+	d->redraw |= job->redraw;  // The update replacing it does it
+	stats.dropped++;
+	long long spawn = stats_clock();
+	int ok = worker_spawn(&d->pool, w);
+	stats_since(&stats.spawn_us, spawn);
+	return ok ? job->worker : -2;
+}
+
+int pool_update(driver_t *d, int at_eof) {
+	size_t render_end;
+	update_end(d, at_eof, &render_end);
+	if (render_end == d->rendered_end && !d->redraw) {
+		d->dirty = 0;
+		return 1;  // Nothing new to show
+	}
+
+	int worker = -1;
+	for (int i = 0; i < d->pool.size && worker < 0; i++) {
+		if (!d->pool.workers[i].busy) worker = i;
+	}
+	if (worker < 0) worker = pool_cancel_newest(d);
+	if (worker == -2) {
+		if (!pool_fail(d)) return 0;
+		return driver_update(d, at_eof);
+	}
+	if (worker < 0) {
+		d->dirty = 1;
+		return 1;
+	}
+	d->dirty = 0;
+
+	update_t u;
+	plan_update(d, at_eof, &u);
+	int teeing = d->job_count == 0 && can_tee(d, &u);
+	job_t *job = job_at(d, d->job_count);
+	buffer_t out = job->out;  // Keep the slot's pooled buffer
+	*job = (job_t){
+	    .worker = worker,
+	    .start = u.start,
+	    .boundary = u.boundary,
+	    .end = u.end,
+	    .render_end = u.render_end,
+	    .fence = u.fence,
+	    .redraw = u.redraw,
+	    .out = out,
+	    .tee = {.fd = teeing ? STDOUT_FILENO : -1},
+	    .dispatched_us = stats_clock(),
+	    .dispatched_ms = now_ms(),
+	};
+	buffer_reset(&job->out);
+	if (!buffer_reserve(&job->out,
+	                    d->shown.len + OUTPUT_EXPANSION * u.new_input)) {
+		return 0;
+	}
+
+	int commit = u.boundary > u.start;
+	int tail = u.render_end > u.boundary;
+	job->frames = commit + tail;
+	job->reopens[0] = commit ? u.reopen_start : u.reopen_boundary;
+	job->reopens[1] = u.reopen_boundary;
+	job->closes[0] = commit ? u.close_boundary : u.close_end;
+	job->closes[1] = u.close_end;
+	if (u.reopen_start || u.reopen_boundary) {
+		memcpy(job->reopen, d->reopen, d->reopen_len);
+		job->reopen_len = d->reopen_len;
+	}
+	for (int f = 0; f < job->frames; f++) {
+		size_t off, len;
+		job_frame(job, f, &off, &len);
+		if (job->reopens[f]) len += job->reopen_len;
+		len += job->closes[f];
+		if (len > UINT32_MAX) {
+			fprintf(stderr, "Render request too large for worker frame.\n");
+			return 0;
+		}
+		frame_header(job->headers[f], len);
+		job->request_len += FRAME_HEADER_SIZE + len;
+	}
+	d->pool.workers[worker].busy = 1;
+	d->job_count++;
+	if (job->frames == 0) {
+		job->done = 1;
+		return pool_emit_ready(d);
+	}
+
+	if (!job_send(d, job)) return pool_fail(d);
+	return 1;
+}
+
+int pool_pollfds(driver_t *d, struct pollfd *fds) {
+	int n = 0;
+	for (int i = 0; i < d->job_count; i++) {
+		job_t *job = job_at(d, i);
+		if (job->done) continue;
+		worker_t *w = &d->pool.workers[job->worker];
+		short events = POLLIN;
+		fds[n++] = (struct pollfd){.fd = w->from_child, .events = events};
+		if (job->sent < job->request_len) {
+			fds[n++] = (struct pollfd){.fd = w->to_child, .events = POLLOUT};
+		}
+	}
+	return n;
+}
+
+int pool_handle(driver_t *d, struct pollfd *fds, int nfds, int at_eof) {
+	int n = 0;
+	int ok = 1;
+	for (int i = 0; i < d->job_count && n < nfds; i++) {
+		job_t *job = job_at(d, i);
+		if (job->done) continue;
+		int readable = fds[n++].revents != 0;
+		int writable = 0;
+		if (job->sent < job->request_len) writable = fds[n++].revents != 0;
+		if (writable && !job_send(d, job)) ok = 0;
+		if (readable && ok && !job_receive(d, job)) ok = 0;
+		if (!ok) break;
+	}
+	ok = ok ? pool_emit_ready(d) : pool_fail(d);
+	if (!ok) return 0;
+	if (d->dirty) return driver_update(d, at_eof);
+	return 1;
+}
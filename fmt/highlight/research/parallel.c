@@ -0,0 +1,231 @@
+#include "parallel.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "backend.h"
+#include "blocks.h"
+#include "coproc.h"
+#include "io.h"
+#include "pool.h"
+#include "stats.h"
+
+// Chunks are at least CHUNK_MIN bytes, aiming for CHUNKS_PER_WORKER of them
+// per worker so one slow chunk can't hold up the rest. Blocks render the same
+// on their own (as commits do), so the output is the chunks' outputs in order.
+#define CHUNK_MIN (16 * 1024)
+#define CHUNKS_PER_WORKER 8
+
+typedef struct {
+	size_t start, len;
+	buffer_t out;
+	int done;
+} chunk_t;
+
+// A worker's progress through its current chunk
+typedef struct {
+	int chunk;  // -1 when idle
+	unsigned char request[FRAME_HEADER_SIZE];
+	size_t sent;  // Header and input bytes written
+	unsigned char response[FRAME_HEADER_SIZE];
+	size_t header_got;
+	size_t want;
+} chunk_worker_t;
+
+// Cut data at block boundaries into chunks of at least target bytes (the
+// last one may be shorter). Returns the number of chunks, 0 on failure.
+static int split_chunks(const char *data, size_t size, size_t target,
+                        chunk_t **chunks) {
+	block_state_t blocks = {0};
+	int count = 0, capacity = 0;
+	*chunks = NULL;
+	size_t start = 0;
+	for (size_t pos = 0; pos < size;) {
+		const char *nl = memchr(data + pos, '\n', size - pos);
+		size_t next = nl ? (size_t)(nl - data) + 1 : size;
+		int cut = block_boundary(&blocks, data + pos, next - pos) &&
+		          next - start >= target;
+		pos = next;
+		if (!cut && pos < size) continue;
+
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			chunk_t *grown = realloc(*chunks, capacity * sizeof(chunk_t));
+			if (!grown) {
+				perror("realloc failed in split_chunks");
+				free(*chunks);
+				return 0;
+			}
+			*chunks = grown;
+		}
+		chunk_t *c = &(*chunks)[count++];
+		*c = (chunk_t){.start = start, .len = pos - start};
+		buffer_init(&c->out);
+		start = pos;
+	}
+	return count;
+}
+
+// Hand chunk i to an idle worker
+static void chunk_assign(chunk_worker_t *cw, chunk_t *c, int i) {
+	*cw = (chunk_worker_t){.chunk = i};
+	frame_header(cw->request, c->len);
+}
+
+// Send and receive whatever the worker's pipes take. Returns 1 on success
+// (including a full or empty pipe), 0 if the worker is gone or I/O failed.
+static int chunk_exchange(worker_t *w, chunk_worker_t *cw, const char *data,
+                          chunk_t *c) {
+	while (cw->sent < FRAME_HEADER_SIZE + c->len) {
+		struct iovec iov[2] = {{cw->request, FRAME_HEADER_SIZE},
+		                       {(char *)data + c->start, c->len}};
+		struct iovec *iovp = iov;
+		int iovcnt = 2;
+		iov_advance(&iovp, &iovcnt, cw->sent);
+		ssize_t n = writev(w->to_child, iovp, iovcnt);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0 && errno == EAGAIN) break;
+		if (n < 0) return 0;
+		cw->sent += n;
+	}
+
+	while (!c->done) {
+		ssize_t n;
+		if (cw->header_got < FRAME_HEADER_SIZE) {
+			n = read(w->from_child, cw->response + cw->header_got,
+			         FRAME_HEADER_SIZE - cw->header_got);
+		} else {
+			n = read(w->from_child, c->out.data + c->out.len,
+			         cw->want - c->out.len);
+		}
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0 && errno == EAGAIN) return 1;
+		if (n <= 0) return 0;
+
+		if (cw->header_got < FRAME_HEADER_SIZE) {
+			cw->header_got += n;
+			if (cw->header_got < FRAME_HEADER_SIZE) continue;
+			unsigned char *h = cw->response;
+			cw->want = frame_length(h);
+			if (!buffer_reserve(&c->out, cw->want)) return 0;
+		} else {
+			c->out.len += n;
+		}
+		if (c->out.len == cw->want) c->done = 1;
+	}
+	return 1;
+}
+
+int render_parallel(const char *data, size_t size, int size_workers,
+                    buffer_t *copy) {
+	size_t target = size / ((size_t)size_workers * CHUNKS_PER_WORKER);
+	if (target < CHUNK_MIN) target = CHUNK_MIN;
+	chunk_t *chunks;
+	int count = split_chunks(data, size, target, &chunks);
+	if (count == 0) return 0;
+	if (count < 2) {
+		free(chunks);
+		return -1;  // One block: nothing to split
+	}
+
+	pool_t pool;
+	long long spawn = stats_clock();
+	if (!pool_start(&pool, size_workers < count ? size_workers : count)) {
+		free(chunks);
+		return -1;
+	}
+	stats_since(&stats.spawn_us, spawn);
+
+	chunk_worker_t cws[MAX_WORKERS];
+	int next = 0;     // Next chunk to hand out
+	int emitted = 0;  // Chunks written to stdout
+	int ok = 1;
+	int write_failed = 0;
+	for (int i = 0; i < pool.size; i++) cws[i].chunk = -1;
+
+	while (ok && emitted < count) {
+		struct pollfd fds[2 * MAX_WORKERS];
+		int owner[2 * MAX_WORKERS];
+		int nfds = 0;
+		for (int i = 0; i < pool.size; i++) {
+			chunk_worker_t *cw = &cws[i];
+			if (cw->chunk < 0 && next < count) {
+				chunk_assign(cw, &chunks[next], next);
+				next++;
+			}
+			if (cw->chunk < 0) continue;
+			short events = POLLIN;
+			if (cw->sent < FRAME_HEADER_SIZE + chunks[cw->chunk].len) {
+				events |= POLLOUT;
+			}
+			owner[nfds] = i;
+			fds[nfds].fd = pool.workers[i].from_child;
+			fds[nfds++].events = POLLIN;
+			if (events & POLLOUT) {
+				owner[nfds] = i;
+				fds[nfds].fd = pool.workers[i].to_child;
+				fds[nfds++].events = POLLOUT;
+			}
+		}
+		if (nfds > 0 && poll(fds, nfds, -1) == -1 && errno != EINTR) break;
+
+		for (int f = 0; f < nfds && ok; f++) {
+			chunk_worker_t *cw = &cws[owner[f]];
+			if (!fds[f].revents || cw->chunk < 0) continue;
+			chunk_t *c = &chunks[cw->chunk];
+			if (!chunk_exchange(&pool.workers[owner[f]], cw, data, c)) {
+				ok = 0;
+			} else if (c->done) {
+				cw->chunk = -1;
+			}
+		}
+
+		// Ordered output, as far as it is finished
+		for (; emitted < count && chunks[emitted].done; emitted++) {
+			chunk_t *c = &chunks[emitted];
+			stats.output_bytes += c->out.len;
+			if ((copy && !buffer_append(copy, c->out.data, c->out.len)) ||
+			    !write_stdout(c->out.data, c->out.len)) {
+				perror("Failed to write output");
+				write_failed = 1;
+				ok = 0;
+				break;
+			}
+			buffer_free(&c->out);
+		}
+	}
+	pool_stop(&pool);
+
+	if (write_failed) {
+		emitted = count;
+	} else if (emitted < count) {
+		fprintf(stderr,
+		        "Warning: highlighter workers unavailable, spawning '%s' per "
+		        "chunk instead.\n",
+		        backend.name);
+	}
+	ok = !write_failed;
+	for (; emitted < count && ok; emitted++) {
+		chunk_t *c = &chunks[emitted];
+		if (!c->done) {
+			buffer_reset(&c->out);
+			ok = run_pygmentize(data + c->start, c->len, &c->out, NULL);
+		}
+		stats.output_bytes += c->out.len;
+		if (ok && copy && !buffer_append(copy, c->out.data, c->out.len)) {
+			ok = 0;
+		}
+		if (ok && !write_stdout(c->out.data, c->out.len)) {
+			perror("Failed to write output");
+			ok = 0;
+		}
+	}
+	for (int i = 0; i < count; i++) buffer_free(&chunks[i].out);
+	free(chunks);
+	stats.renders = count;
+	return ok;
+}
@@ -0,0 +1,21 @@
+#ifndef HL_PARALLEL_H
+#define HL_PARALLEL_H
+
+#include <stddef.h>  // For size_t
+
+#include "buffer.h"
+
+// A file at least this large is split at block boundaries and rendered on
+// the worker pool
+#define PARALLEL_MIN (256 * 1024)
+
+// Render data in chunks on a pool of size workers, writing each chunk as
+// soon as every chunk before it is out. Idle workers take the next chunk in
+// line, so a worker stuck on a big fence doesn't hold up the others. If the
+// pool breaks, the unfinished chunks are rendered one spawn each. The whole
+// output is also appended to copy, if given.
+// Returns 1 on success, 0 on failure, -1 if the pool isn't available
+int render_parallel(const char *data, size_t size, int size_workers,
+                    buffer_t *copy);
+
+#endif
@@ -0,0 +1,147 @@
+#define _POSIX_C_SOURCE 200809L
+#include "pool.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "backend.h"
+#include "coproc.h"  // For coproc_script_path()
+#include "io.h"
+
+// Spawn the zygote. Returns 1 on success, 0 on failure
+static int zygote_start(pool_t *p) {
+	int sv[2];
+	char script[PATH_MAX];
+
+	coproc_script_path(script, sizeof(script));
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		perror("socketpair failed");
+		return 0;
+	}
+	pid_t pid = fork();
+	if (pid == -1) {
+		perror("fork failed");
+		close(sv[0]);
+		close(sv[1]);
+		return 0;
+	}
+	if (pid == 0) {  // Child process
+		close(sv[0]);
+		// stdout too, so the zygote doesn't hold ours open
+		if (dup2(sv[1], STDIN_FILENO) == -1 ||
+		    dup2(sv[1], STDOUT_FILENO) == -1) {
+			_exit(EXIT_FAILURE);
+		}
+		close(sv[1]);
+		const char *args[] = {script, "--zygote", backend.name, NULL};
+		execvp(args[0], (char *const *)args);
+		_exit(EXIT_FAILURE);  // Quiet: the driver falls back to a coprocess
+	}
+	close(sv[1]);
+	set_cloexec_nonblock(sv[0], 0);
+	p->zygote = sv[0];
+	p->zygote_pid = pid;
+	return 1;
+}
+
+int worker_spawn(pool_t *p, worker_t *w) {
+	int req[2], resp[2];
+	if (pipe(req) == -1) return 0;
+	if (pipe(resp) == -1) {
+		close(req[0]);
+		close(req[1]);
+		return 0;
+	}
+
+	int fds[2] = {req[0], resp[1]};
+	union {
+		char buf[CMSG_SPACE(sizeof(fds))];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof(control));
+	char byte = 'w';
+	struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+	struct msghdr mh = {
+	    .msg_iov = &iov,
+	    .msg_iovlen = 1,
+	    .msg_control = control.buf,
+	    .msg_controllen = sizeof(control.buf),
+	};
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+	ssize_t n;
+	do {
+		n = sendmsg(p->zygote, &mh, 0);
+	} while (n == -1 && errno == EINTR);
+	close(req[0]);
+	close(resp[1]);
+
+	unsigned char reply[4];
+	size_t got = 0;
+	while (n == 1 && got < sizeof(reply)) {
+		ssize_t r = read(p->zygote, reply + got, sizeof(reply) - got);
+		if (r < 0 && errno == EINTR) continue;
+		if (r <= 0) break;
+		got += r;
+	}
+	if (got < sizeof(reply)) {
+		close(req[1]);
+		close(resp[0]);
+		return 0;
+	}
+
+	w->pid = (pid_t)((uint32_t)reply[0] << 24 | (uint32_t)reply[1] << 16 |
+	                 (uint32_t)reply[2] << 8 | reply[3]);
+	w->to_child = req[1];
+	w->from_child = resp[0];
+	w->busy = 0;
+	set_cloexec_nonblock(w->to_child, 1);
+	set_cloexec_nonblock(w->from_child, 1);
+	return 1;
+}
+
+void worker_stop(worker_t *w, int kill_it) {
+	if (w->pid <= 0) return;
+	if (kill_it) kill(w->pid, SIGKILL);
+	close(w->to_child);
+	close(w->from_child);
+	w->pid = 0;
+	w->busy = 0;
+}
+
+void pool_stop(pool_t *p) {
+	for (int i = 0; i < p->size; i++) {
+		worker_stop(&p->workers[i], p->workers[i].busy);
+	}
+	if (p->zygote >= 0) {
+		close(p->zygote);
+		waitpid(p->zygote_pid, NULL, 0);
+	}
+	p->zygote = -1;
+	p->size = 0;
+}
+
+int pool_start(pool_t *p, int size) {
+	p->zygote = -1;
+	p->size = 0;
+	if (size <= 0 || !zygote_start(p)) return 0;
+	for (; p->size < size; p->size++) {
+		if (!worker_spawn(p, &p->workers[p->size])) {
+			pool_stop(p);
+			return 0;
+		}
+	}
+	return 1;
+}
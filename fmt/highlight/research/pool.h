@@ -0,0 +1,47 @@
+#ifndef HL_POOL_H
+#define HL_POOL_H
+
+#include <sys/types.h>
+
+// Pre-forked highlighter workers, all forked from one zygote (coproc.py
+// --zygote) that has already imported and warmed up the highlighter, so a
+// new worker costs a fork() instead of an interpreter start. Each worker
+// speaks the coprocess protocol, which lets renders be pipelined: the next
+// one runs on an idle worker while the last result is still being diffed
+// and written, and a render that newer input made pointless is killed.
+// Concurrent renders only pay off with a CPU for each, so a single-CPU
+// machine defaults to one worker.
+
+#define DEFAULT_WORKERS 2
+#define MAX_WORKERS 8
+
+typedef struct {
+	pid_t pid;       // 0 for an empty slot
+	int to_child;    // Request pipe, non-blocking
+	int from_child;  // Response pipe, non-blocking
+	int busy;        // A job is running on it
+} worker_t;
+
+typedef struct {
+	pid_t zygote_pid;
+	int zygote;  // Control socket, -1 when the pool is off
+	int size;
+	worker_t workers[MAX_WORKERS];
+} pool_t;
+
+// Start the zygote and size workers. Returns 1 on success, 0 if the pool is
+// not available (e.g. a coprocess script without --zygote)
+int pool_start(pool_t *p, int size);
+
+// Stop all workers, then the zygote (EOF on its socket)
+void pool_stop(pool_t *p);
+
+// Have the zygote fork a worker into w: send it the far ends of two pipes,
+// read back the worker's pid. Returns 1 on success, 0 on failure
+int worker_spawn(pool_t *p, worker_t *w);
+
+// Close a worker's pipes, which ends it once it is idle. A busy one might
+// still be rendering something nobody wants, so it can be killed instead.
+void worker_stop(worker_t *w, int kill_it);
+
+#endif
@@ -1,296 +1,334 @@
-#define _POSIX_C_SOURCE \
-	200809L  // For fdopen, dprintf if needed, although not strictly used here
+#define _GNU_SOURCE  // For madvise()
+
 #include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
 #include <stddef.h>  // For size_t
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/types.h>
-#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-#define READ_CHUNK_SIZE 4096
-#define OUTPUT_CHUNK_SIZE 4096
-
-// Structure to hold dynamically growing buffer
-typedef struct {
-	char *data;
-	size_t len;
-	size_t capacity;
-} buffer_t;
-
-// Initialize a buffer
-void buffer_init(buffer_t *buf) {
-	buf->data = NULL;
-	buf->len = 0;
-	buf->capacity = 0;
+#include "backend.h"
+#include "cache.h"
+#include "driver.h"
+#include "parallel.h"
+#include "stats.h"
+
+// Which highlighter to drive. rich.c defines HL_BACKEND_RICH and includes
+// this file; the modules are shared.
+#ifdef HL_BACKEND_RICH
+static const char *const backend_args[] = {"rich", "--markdown", "-", NULL};
+const backend_t backend = {
+    .name = "rich",
+    .args = backend_args,
+    .wraps = 1,
+    .closes_fences = 0,  // An unclosed fence renders as code
+};
+#else
+// stripnl=False keeps blank lines at the edges of a render, which matters
+// once the tail after a checkpoint is rendered on its own
+static const char *const backend_args[] = {
+    "pygmentize", "-l", "markdown", "-O", "stripnl=False", NULL};
+const backend_t backend = {
+    .name = "pygmentize",
+    .args = backend_args,
+    .wraps = 0,
+    .closes_fences = 1,
+};
+#endif
+
+// Input that arrives within this window is rendered as one batch
+#define DEFAULT_BATCH_MS 16
+#define DEFAULT_BATCH_BYTES 65536
+
+// On a terminal, updates are shown at most this many times a second; one
+// that is superseded before its frame is due never reaches the screen
+#define DEFAULT_FPS 60
+
+// Set by SIGWINCH, handled in the main loop
+static volatile sig_atomic_t resized;
+
+static void on_sigwinch(int sig) {
+	(void)sig;
+	resized = 1;
 }
 
-// Append data to a buffer, reallocating if necessary
-int buffer_append(buffer_t *buf, const char *data, size_t len) {
-	if (buf->len + len > buf->capacity) {
-		size_t new_capacity =
-		    buf->capacity ? buf->capacity * 2 : READ_CHUNK_SIZE;
-		while (new_capacity < buf->len + len) {
-			new_capacity *= 2;
+// stdin is a regular file (`hlmd-st < file.md`, a saved conversation): there
+// is nothing to stream, so map it and highlight it with no incremental
+// diffing: in a single render, or with workers > 1 and a large file, on the
+// worker pool (see render_parallel()). With a cache (see cache_dir()), a
+// file shown before is written straight from there.
+// Returns 1 on success, 0 on failure
+static int render_mapped_file(int fd, size_t size, int workers,
+                              int want_cache) {
+	char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		perror("Failed to mmap stdin");
+		return 0;
+	}
+	madvise(data, size, MADV_SEQUENTIAL);
+
+	stats.input_bytes = size;
+	stats.branch = "mapped";
+	char dir[PATH_MAX], name[64], file[PATH_MAX + 64];
+	int cached = cache_dir(dir, sizeof(dir), want_cache);
+	if (cached) {
+		cache_key(data, size, name, sizeof(name));
+		snprintf(file, sizeof(file), "%s/%s", dir, name);
+		int hit = cache_lookup(file);
+		if (hit != 0) {
+			munmap(data, size);
+			stats_record(0);
+			return hit > 0;
 		}
-		char *new_data = realloc(buf->data, new_capacity);
-		if (!new_data) {
-			perror("realloc failed in buffer_append");
-			return 0;  // Failure
+	}
+
+	buffer_t out;
+	buffer_init(&out);
+	int ok = -1;
+	if (workers > 1 && size >= PARALLEL_MIN && size <= UINT32_MAX) {
+		ok = render_parallel(data, size, workers, cached ? &out : NULL);
+	}
+	if (ok < 0) {
+		ok = buffer_reserve(&out, OUTPUT_EXPANSION * size) &&
+		     run_pygmentize(data, size, &out, NULL);
+		if (ok && !write_stdout(out.data, out.len)) {
+			perror("Failed to write output");
+			ok = 0;
 		}
-		buf->data = new_data;
-		buf->capacity = new_capacity;
+		stats.renders = 1;
+		stats.output_bytes = out.len;
 	}
-	memcpy(buf->data + buf->len, data, len);
-	buf->len += len;
-	return 1;  // Success
+	munmap(data, size);
+	if (ok && cached && out.len > 0) cache_store(dir, name, &out);
+	stats_record(0);
+	buffer_free(&out);
+	return ok;
 }
 
-// Free buffer memory
-void buffer_free(buffer_t *buf) {
-	free(buf->data);
-	buffer_init(buf);  // Reset state
+static void usage(const char *argv0) {
+	fprintf(stderr,
+	        "usage: %s [--batch-ms N] [--batch-bytes N] [--no-partial] "
+	        "[--workers N] [--fps N] [--no-sync]\n"
+	        "       [--max-window N] [--budget-ms N] [--cache] [--stats]\n"
+	        "  --batch-ms N     gather input for up to N ms before rendering "
+	        "(default %d, 0 = render every read)\n"
+	        "  --batch-bytes N  render early once N bytes are pending "
+	        "(default %d)\n"
+	        "  --no-partial     don't show a line until its newline arrives "
+	        "(on by default when stdout is a terminal)\n"
+	        "  --workers N      highlighter workers for pipelined renders "
+	        "(default %d, 1 on a\n"
+	        "                   single CPU, 0 = one coprocess, no "
+	        "pipelining); with a\n"
+	        "                   file on stdin, for rendering it in parallel "
+	        "(default: CPUs)\n"
+	        "  --fps N          show at most N updates a second on a terminal "
+	        "(default %d,\n"
+	        "                   0 = every update)\n"
+	        "  --no-sync        don't wrap updates in synchronized output "
+	        "(DEC mode 2026)\n"
+	        "  --max-window N   commit a block still open after N bytes at "
+	        "its last line\n"
+	        "                   (default %d, 0 = never)\n"
+	        "  --budget-ms N    cut blocks sooner when renders take over N ms, "
+	        "show the\n"
+	        "                   rest of a block plain if even small ones do "
+	        "(default %d,\n"
+	        "                   0 = never)\n"
+	        "  --cache          keep renders of files on stdin in "
+	        "~/.cache/hinata/highlight\n"
+	        "                   (HLMD_CACHE_DIR=dir also turns it on, "
+	        "HLMD_CACHE_MAX=bytes)\n"
+	        "  --stats          print per-update timings as JSON lines to "
+	        "stderr on exit\n"
+	        "                   (HLMD_STATS=path writes them there as they "
+	        "happen)\n",
+	        argv0, DEFAULT_BATCH_MS, DEFAULT_BATCH_BYTES, DEFAULT_WORKERS,
+	        DEFAULT_FPS, DEFAULT_MAX_WINDOW, DEFAULT_BUDGET_MS);
 }
 
-// Function to run pygmentize and capture its output
-// Returns a dynamically allocated string with the output (must be freed by
-// caller) Returns NULL on failure
-char *run_pygmentize(const char *input_data, size_t input_len,
-                     size_t *output_len) {
-	int stdin_pipe[2];   // Pipe for sending data to pygmentize's stdin
-	int stdout_pipe[2];  // Pipe for receiving data from pygmentize's stdout
-	pid_t pid;
-
-	if (pipe(stdin_pipe) == -1 || pipe(stdout_pipe) == -1) {
-		perror("pipe failed");
-		// Close any pipes that were opened successfully
-		if (stdin_pipe[0] != -1) close(stdin_pipe[0]);
-		if (stdin_pipe[1] != -1) close(stdin_pipe[1]);
-		if (stdout_pipe[0] != -1) close(stdout_pipe[0]);
-		if (stdout_pipe[1] != -1) close(stdout_pipe[1]);
-		return NULL;
+int main(int argc, char **argv) {
+	long batch_ms = DEFAULT_BATCH_MS;
+	long batch_bytes = DEFAULT_BATCH_BYTES;
+	int tty = isatty(STDOUT_FILENO);
+	int partial = tty;
+	int want_stats = 0;
+	int want_cache = 0;
+	long fps = DEFAULT_FPS;
+	long max_window = DEFAULT_MAX_WINDOW;
+	long budget_ms = DEFAULT_BUDGET_MS;
+	const char *term = getenv("TERM");
+	int sync_output = tty && !(term && strcmp(term, "dumb") == 0);
+	long workers = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? DEFAULT_WORKERS : 1;
+	int workers_given = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--batch-ms") == 0 && i + 1 < argc) {
+			batch_ms = atol(argv[++i]);
+		} else if (strcmp(argv[i], "--batch-bytes") == 0 && i + 1 < argc) {
+			batch_bytes = atol(argv[++i]);
+		} else if (strcmp(argv[i], "--no-partial") == 0) {
+			partial = 0;
+		} else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+			workers = atol(argv[++i]);
+			workers_given = 1;
+			if (workers < 0) workers = 0;
+			if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+		} else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+			fps = atol(argv[++i]);
+		} else if (strcmp(argv[i], "--max-window") == 0 && i + 1 < argc) {
+			max_window = atol(argv[++i]);
+		} else if (strcmp(argv[i], "--budget-ms") == 0 && i + 1 < argc) {
+			budget_ms = atol(argv[++i]);
+		} else if (strcmp(argv[i], "--no-sync") == 0) {
+			sync_output = 0;
+		} else if (strcmp(argv[i], "--cache") == 0) {
+			want_cache = 1;
+		} else if (strcmp(argv[i], "--stats") == 0) {
+			want_stats = 1;
+		} else {
+			usage(argv[0]);
+			return strcmp(argv[i], "-h") && strcmp(argv[i], "--help")
+			           ? EXIT_FAILURE
+			           : EXIT_SUCCESS;
+		}
 	}
 
-	pid = fork();
-	if (pid == -1) {
-		perror("fork failed");
-		close(stdin_pipe[0]);
-		close(stdin_pipe[1]);
-		close(stdout_pipe[0]);
-		close(stdout_pipe[1]);
-		return NULL;
+	// A dead child must not kill us with SIGPIPE; writes report EPIPE instead
+	signal(SIGPIPE, SIG_IGN);
+	if (tty) {
+		// No SA_RESTART: poll() returns EINTR and the redraw happens at once
+		struct sigaction sa = {.sa_handler = on_sigwinch};
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGWINCH, &sa, NULL);
+	}
+	stats_init(want_stats);
+
+	// One spawn beats starting the coprocess for a single render
+	struct stat in_st;
+	if (fstat(STDIN_FILENO, &in_st) == 0 && S_ISREG(in_st.st_mode) &&
+	    in_st.st_size > 0 && (uintmax_t)in_st.st_size <= SIZE_MAX) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		if (!workers_given) workers = cpus < MAX_WORKERS ? cpus : MAX_WORKERS;
+		int ok = render_mapped_file(STDIN_FILENO, in_st.st_size, workers,
+		                            want_cache);
+		stats_finish();
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 	}
 
-	if (pid == 0) {  // Child process
-		// Close unused pipe ends
-		close(stdin_pipe[1]);   // Close write end of stdin pipe
-		close(stdout_pipe[0]);  // Close read end of stdout pipe
-
-		// Redirect stdin to read from the stdin pipe
-		if (dup2(stdin_pipe[0], STDIN_FILENO) == -1) {
-			perror("dup2 stdin failed");
-			_exit(EXIT_FAILURE);  // Use _exit in child after fork
-		}
-		close(stdin_pipe[0]);  // Close original fd
-
-		// Redirect stdout to write to the stdout pipe
-		if (dup2(stdout_pipe[1], STDOUT_FILENO) == -1) {
-			perror("dup2 stdout failed");
-			_exit(EXIT_FAILURE);
+	driver_t d = {0};
+	d.tty = tty;
+	d.partial = partial;
+	d.frame_ms = tty && fps > 0 ? (1000 + fps - 1) / fps : 0;
+	d.sync_output = sync_output;
+	d.max_window = max_window > 0 ? (size_t)max_window : 0;
+	d.budget_ms = budget_ms > 0 ? budget_ms : 0;
+	driver_init(&d, workers);
+
+	int status = EXIT_SUCCESS;
+	int eof = 0;
+	int read_failed = 0;       // Shown up to the error, then exit nonzero
+	int pending = 0;           // Input arrived since the last render
+	long long deadline = 0;    // When the pending batch must be rendered
+	size_t batch_start = 0;    // input_end() when the batch started
+
+	// Bytes that arrive within one batch window are rendered together, so
+	// the number of renders per second is bounded however fast input comes.
+	// poll() guards every read(), so stdin itself is left blocking (it may
+	// be a tty shared with the parent shell).
+	while (!eof) {
+		// A resize is redrawn like a frame, so dragging the window edge
+		// doesn't redraw more often than the frame rate
+		int redraw_in = -1;
+		if (resized) {
+			long long left = d.last_frame + d.frame_ms - now_ms();
+			redraw_in = left > 0 ? (int)left : 0;
 		}
-		close(stdout_pipe[1]);  // Close original fd
-
-		// Prepare arguments for pygmentize
-		const char *args[] = {"pygmentize", "-l", "markdown", NULL};
-
-		// Execute pygmentize
-		execvp(args[0], (char *const *)args);
-
-		// If execvp returns, it failed
-		perror("execvp pygmentize failed");
-		fprintf(stderr, "Ensure 'pygmentize' is installed and in your PATH.\n");
-		_exit(EXIT_FAILURE);
-
-	} else {  // Parent process
-		buffer_t output_buffer;
-		buffer_init(&output_buffer);
-		char read_buf[OUTPUT_CHUNK_SIZE];
-		ssize_t bytes_read_from_child;
-		ssize_t total_written = 0;
-		ssize_t bytes_written;
-
-		// Close unused pipe ends
-		close(stdin_pipe[0]);   // Close read end of stdin pipe
-		close(stdout_pipe[1]);  // Close write end of stdout pipe
-
-		// Write input data to pygmentize's stdin
-		// Loop to handle potential partial writes
-		while (total_written < input_len) {
-			bytes_written = write(stdin_pipe[1], input_data + total_written,
-			                      input_len - total_written);
-			if (bytes_written <= 0) {
-				if (bytes_written == -1 &&
-				    errno != EPIPE) {  // Ignore broken pipe, it means child
-					                   // exited potentially
-					perror("write to child stdin failed");
-				}
-				// Might happen if child exits early due to error or short input
+		if (redraw_in == 0) {
+			resized = 0;
+			redraw_in = -1;
+			// Rendered again and drawn whole, as the next frame
+			d.redraw = !d.first_run && d.shown.len > 0 && !d.plain;
+			if (d.redraw && !driver_update(&d, 0)) {
+				status = EXIT_FAILURE;
 				break;
 			}
-			total_written += bytes_written;
 		}
-		close(stdin_pipe[1]);  // Close write end - signals EOF to child's stdin
 
-		// Read output from pygmentize's stdout
-		while ((bytes_read_from_child =
-		            read(stdout_pipe[0], read_buf, sizeof(read_buf))) > 0) {
-			if (!buffer_append(&output_buffer, read_buf,
-			                   bytes_read_from_child)) {
-				// Error appending (likely memory allocation failure)
-				buffer_free(&output_buffer);
-				close(stdout_pipe[0]);
-				waitpid(pid, NULL, 0);  // Clean up zombie process
-				return NULL;
-			}
+		int timeout = min_timeout(frame_timeout(&d), redraw_in);
+		if (pending) {
+			long long left = deadline - now_ms();
+			timeout = min_timeout(timeout, left > 0 ? (int)left : 0);
 		}
-		close(stdout_pipe[0]);  // Close read end
 
-		if (bytes_read_from_child == -1) {
-			perror("read from child stdout failed");
-			buffer_free(&output_buffer);
-			waitpid(pid, NULL, 0);
-			return NULL;
+		// Workers with a job in flight are polled along with stdin
+		struct pollfd fds[1 + 2 * MAX_WORKERS];
+		fds[0] = (struct pollfd){.fd = STDIN_FILENO, .events = POLLIN};
+		int nfds = 1 + pool_pollfds(&d, fds + 1);
+		int ready = poll(fds, nfds, timeout);
+		if (ready == -1) {
+			if (errno == EINTR) continue;
+			perror("poll on stdin failed");
+			status = EXIT_FAILURE;
+			break;
 		}
-
-		// Wait for child process to terminate and check status
-		int status;
-		waitpid(pid, &status, 0);
-		if (!(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
-			fprintf(stderr,
-			        "Warning: pygmentize process did not exit cleanly (status "
-			        "%d).\n",
-			        WEXITSTATUS(status));
-			// Continue anyway, maybe got partial output
+		if (ready > 0 && !pool_handle(&d, fds + 1, nfds - 1, 0)) {
+			status = EXIT_FAILURE;
+			break;
 		}
-
-		// Null-terminate the buffer data (important!)
-		if (!buffer_append(&output_buffer, "\0", 1)) {
-			fprintf(stderr, "Failed to null-terminate output buffer.\n");
-			buffer_free(&output_buffer);
-			return NULL;
+		if (!frame_tick(&d, 0)) {
+			status = EXIT_FAILURE;
+			break;
 		}
 
-		*output_len =
-		    output_buffer.len - 1;  // Store length excluding null terminator
-		return output_buffer.data;  // Return ownership of the buffer data
-	}
-}
-
-int main() {
-	buffer_t input_buf;
-	buffer_init(&input_buf);
-
-	char *prev_output = NULL;
-	size_t prev_output_len = 0;
-
-	int first_run = 1;
-	char *line = NULL;         // Buffer for getline
-	size_t line_capacity = 0;  // Capacity of the buffer
-	ssize_t line_len;          // Length of the line read
-
-	// Read from stdin line by line using getline
-	while ((line_len = getline(&line, &line_capacity, stdin)) != -1) {
-		// Append the line (which includes the newline, if present) to the input
-		// buffer
-		if (!buffer_append(&input_buf, line, line_len)) {
-			fprintf(stderr, "Error appending stdin line to input buffer.\n");
-			buffer_free(&input_buf);
-			free(prev_output);
-			free(line);  // Free getline buffer before exiting
-			return EXIT_FAILURE;
-		}
-
-		// Run pygmentize with the current complete input buffer
-		size_t current_output_len = 0;
-		char *current_output =
-		    run_pygmentize(input_buf.data, input_buf.len, &current_output_len);
-
-		if (!current_output) {
-			fprintf(stderr, "Error running pygmentize.\n");
-			buffer_free(&input_buf);
-			free(prev_output);
-			free(line);  // Free getline buffer before exiting
-			return EXIT_FAILURE;
-		}
-
-		// Compare and write output
-		if (first_run) {
-			// First time, write the whole output
-			ssize_t written =
-			    write(STDOUT_FILENO, current_output, current_output_len);
-			if (written < 0 || (size_t)written != current_output_len) {
-				perror("Failed to write initial output");
-				// Consider if we should exit here or just warn
+		if (fds[0].revents) {
+			input_release(&d);
+			if (!buffer_reserve(&d.input_buf, READ_CHUNK_SIZE)) {
+				status = EXIT_FAILURE;
+				break;
 			}
-			first_run = 0;
-		} else {
-			// Subsequent times, find the difference
-			if (prev_output && current_output_len >= prev_output_len &&
-			    memcmp(current_output, prev_output, prev_output_len) == 0) {
-				// The new output starts with the previous output, print only
-				// the suffix
-				size_t diff_len = current_output_len - prev_output_len;
-				if (diff_len > 0) {
-					ssize_t written =
-					    write(STDOUT_FILENO, current_output + prev_output_len,
-					          diff_len);
-					if (written < 0 || (size_t)written != diff_len) {
-						perror("Failed to write diff output");
-						// Consider if we should exit here or just warn
-					}
-				}
+			ssize_t n = read(STDIN_FILENO, d.input_buf.data + d.input_buf.len,
+			                 READ_CHUNK_SIZE);
+			if (n < 0) {
+				if (errno == EINTR || errno == EAGAIN) continue;
+				perror("Error reading from stdin");
+				read_failed = 1;
+				eof = 1;
+			} else if (n == 0) {
+				eof = 1;
 			} else {
-				// Output doesn't start with previous, or shrunk.
-				// This can happen if edits remove ANSI sequences or change
-				// structure significantly. Safest bet is to clear screen (if
-				// interactive) and rewrite the whole thing. For simplicity,
-				// just rewrite without clearing. Optionally add a clear screen
-				// sequence: write(STDOUT_FILENO, "\033[H\033[J", 6);
-				fprintf(stderr,
-				        "\nWarning: Pygmentize output inconsistency detected "
-				        "or structural change. Rewriting full output.\n");
-				ssize_t written =
-				    write(STDOUT_FILENO, current_output, current_output_len);
-				if (written < 0 || (size_t)written != current_output_len) {
-					perror("Failed to rewrite full output");
+				d.input_buf.len += n;
+				if (!pending) {
+					pending = 1;
+					deadline = now_ms() + batch_ms;
+					batch_start = input_end(&d) - n;
 				}
 			}
 		}
-		fflush(stdout);  // Ensure output is flushed immediately
 
-		// Update previous output
-		free(prev_output);             // Free the old previous output
-		prev_output = current_output;  // Take ownership of the new output
-		prev_output_len = current_output_len;
-		// Do NOT free current_output here, it's now prev_output
-
-		// The 'line' buffer is automatically reused or reallocated by getline
-		// in the next iteration.
-	}  // End while loop reading stdin with getline
-
-	// Check for errors after the loop (getline returns -1 on EOF or error)
-	if (ferror(stdin)) {
-		perror("Error reading from stdin using getline");
-		// Decide on exit strategy if needed
+		if (pending && !eof &&
+		    (now_ms() >= deadline ||
+		     input_end(&d) - batch_start >= (size_t)batch_bytes)) {
+			if (!driver_update(&d, 0)) {
+				status = EXIT_FAILURE;
+				break;
+			}
+			pending = 0;
+		}
 	}
 
-	// Clean up the buffer allocated by getline
-	free(line);
+	// Render whatever is left, including a final line without a newline
+	if (status == EXIT_SUCCESS && !driver_finish(&d)) status = EXIT_FAILURE;
+	if (read_failed) status = EXIT_FAILURE;
 
-	// Clean up
-	buffer_free(&input_buf);
-	free(prev_output);
+	driver_free(&d);
+	stats_finish();
 
-	return EXIT_SUCCESS;
+	return status;
 }
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "driver.h"
+#include "stats.h"
+#include "term.h"
+
+// DEC private mode 2026: the terminal holds off drawing between these, so
+// a repaint shows up at once instead of tearing. Terminals without it
+// ignore the unknown mode.
+#define SYNC_BEGIN "\033[?2026h"
+#define SYNC_END "\033[?2026l"
+
+// Write one frame to stdout with a single writev(), inside a synchronized
+// update when the terminal gets those. Returns 1 on success, 0 on failure
+static int write_frame(driver_t *d, struct iovec *parts, int count) {
+	struct iovec iov[4];
+	int n = 0;
+	size_t len = 0;
+	if (d->sync_output) {
+		iov[n++] = (struct iovec){SYNC_BEGIN, sizeof(SYNC_BEGIN) - 1};
+	}
+	for (int i = 0; i < count; i++) {
+		iov[n++] = parts[i];
+		len += parts[i].iov_len;
+	}
+	if (len == 0) return 1;
+	if (d->sync_output) {
+		iov[n++] = (struct iovec){SYNC_END, sizeof(SYNC_END) - 1};
+		len += sizeof(SYNC_BEGIN) - 1 + sizeof(SYNC_END) - 1;
+	}
+	long long t = stats_clock();
+	int ok = writev_all(STDOUT_FILENO, iov, n);
+	stats_since(&stats.stdout_us, t);
+	stats.stdout_bytes += len;
+	return ok;
+}
+
+int write_output(driver_t *d, const char *data, size_t len) {
+	struct iovec iov = {.iov_base = (char *)data, .iov_len = len};
+	return write_frame(d, &iov, 1);
+}
+
+// Move the cursor up rows_up rows to column 0, clear to the end of the
+// screen and write text. One syscall for the cursor motion and the text, so
+// the terminal never shows a cleared screen waiting for its contents.
+// Returns 1 on success, 0 on failure
+static int repaint_rows(driver_t *d, int rows_up, const char *text,
+                        size_t len) {
+	char move[32];
+	int n = rows_up > 0
+	            ? snprintf(move, sizeof(move), "\r\033[%dA\033[J", rows_up)
+	            : snprintf(move, sizeof(move), "\r\033[J");
+	struct iovec iov[2] = {
+	    {.iov_base = move, .iov_len = n},
+	    {.iov_base = (char *)text, .iov_len = len},
+	};
+	if (!write_frame(d, iov, 2)) {
+		perror("Failed to repaint output");
+		return 0;
+	}
+	return 1;
+}
+
+// Repaint the terminal from the first line where current_output differs
+// from what is on screen (the shown line same, at line_start in it): move
+// the cursor up to that line, clear to the end of the screen and write the
+// rest of current_output. If that line has already scrolled off, only the
+// visible screen is repainted, so a divergence never costs more than one
+// screenful of output.
+// Returns 1 on success, 0 on failure
+static int repaint_from_divergence(driver_t *d, size_t same,
+                                   size_t line_start) {
+	buffer_t *cur = &d->current_output;
+	int columns, height;
+	terminal_size(&columns, &height);
+	int rows_up = shown_rows(&d->shown, same, height - 1, columns);
+	size_t from = line_start;
+	if (rows_up >= height) {
+		// The divergence scrolled off: repaint what fits on the screen
+		rows_up = height - 1;
+		from = tail_for_rows(cur->data, cur->len, height - 1, columns);
+		if (from < line_start) from = line_start;
+	}
+	return repaint_rows(d, rows_up, cur->data + from, cur->len - from);
+}
+
+// After a resize the terminal has rewrapped (or cut) the rows it shows at
+// the new width: draw the visible part of the window again from the new
+// render, whose first same lines are the ones shown. Only the shown lines
+// that fit on the screen at that width are redrawn; rows in the scrollback
+// are left alone, and the next repaint that reaches them wraps them then.
+// Returns 1 on success, 0 on failure
+static int redraw_window(driver_t *d, size_t same) {
+	buffer_t *cur = &d->current_output;
+	const shown_t *shown = &d->shown;
+	int columns, height;
+	terminal_size(&columns, &height);
+	int rows_up = 0;
+	size_t top = shown->count;
+	size_t from = shown->len;
+	while (top > 0) {
+		const shown_line_t *line = &shown->lines[top - 1];
+		int rows = rows_for_columns(line->cols, columns);
+		if (top < shown->count || !shown->partial) rows++;
+		if (rows_up + rows > height - 1) break;
+		rows_up += rows;
+		from -= line->len;
+		top--;
+	}
+	if (top == shown->count || same < top) {
+		// Nothing shown fits whole, or the render differs above the
+		// screen: draw the screenful it ends with
+		rows_up = height - 1;
+		from = tail_for_rows(cur->data, cur->len, height - 1, columns);
+	}
+	stats.branch = "redraw";
+	return repaint_rows(d, rows_up, cur->data + from, cur->len - from);
+}
+
+// Write whatever part of current_output (the new uncommitted window) is not on
+// screen yet. Its first commit_len bytes are then committed and dropped, and
+// the rest is what is shown.
+// Returns 1 on success, 0 if writing failed
+static int emit_output(driver_t *d, size_t commit_len) {
+	buffer_t *cur = &d->current_output;
+	shown_t *shown = &d->shown;
+
+	long long t = stats_clock();
+	size_t line_start;
+	size_t same = shown_match(shown, cur->data, cur->len, &line_start);
+	int extends = same == shown->count;
+	if (!d->first_run) stats_since(&stats.diff_us, t);
+
+	if (d->first_run) {
+		// First time, write the whole output (minus what was tee()d already)
+		stats.branch = "first";
+		if (!write_output(d, cur->data + d->tee.copied,
+		                  cur->len - d->tee.copied)) {
+			perror("Failed to write initial output");
+			return 0;
+		}
+		d->first_run = 0;
+	} else if (d->window_redraw && d->tty) {
+		if (!redraw_window(d, same)) return 0;
+	} else if (extends) {
+		// The new output starts with the previous output, print only the
+		// suffix. If a fence on screen was closed provisionally and isn't
+		// anymore, its own closing line just arrived: without the
+		// provisional close, every line of it would have changed.
+		stats.branch = "suffix";
+		if (d->shown_fence && d->shown_fence != d->window_fence) {
+			stats.avoided++;
+		}
+		size_t skip = shown->len + d->tee.copied;
+		if (cur->len > skip &&
+		    !write_output(d, cur->data + skip, cur->len - skip)) {
+			perror("Failed to write diff output");
+			return 0;
+		}
+	} else if (d->tty) {
+		// Structural change (a closed fence, a provisional partial line
+		// reconciled once its newline arrived, ...): rewrite in place
+		stats.branch = "repaint";
+		if (!repaint_from_divergence(d, same, line_start)) return 0;
+	} else {
+		// Output doesn't start with previous, or shrunk, and we can't move
+		// the cursor in a pipe. Rewrite everything since the last commit.
+		fprintf(stderr,
+		        "\nWarning: Pygmentize output inconsistency detected "
+		        "or structural change. Rewriting uncommitted output.\n");
+		stats.branch = "rewrite";
+		if (!write_output(d, cur->data, cur->len)) {
+			perror("Failed to rewrite uncommitted output");
+			return 0;
+		}
+	}
+
+	// Keep the lines still uncommitted: the ones that matched stay as they
+	// are, except an unfinished last one, which may have grown
+	t = stats_clock();
+	if (commit_len) {
+		shown_truncate(shown, 0);
+		d->committed_len += commit_len;
+	} else {
+		if (same > 0 && same == shown->count && shown->partial) same--;
+		shown_truncate(shown, same);
+	}
+	// Out of memory leaves the rest unindexed, so it is written again
+	size_t from = commit_len ? commit_len : shown->len;
+	shown_index(shown, cur->data + from, cur->len - from);
+	stats_since(&stats.diff_us, t);
+	buffer_reset(cur);
+	if (commit_len) buffer_shrink(cur);
+	d->shown_fence = d->window_fence;
+	d->window_redraw = 0;
+	return 1;
+}
+
+// Show the held frame, if any
+// Returns 1 on success, 0 on failure
+static int frame_show(driver_t *d) {
+	if (!d->frame_held) return 1;
+	buffer_swap(&d->frame, &d->current_output);
+	d->window_fence = d->frame_fence;
+	d->window_redraw = d->frame_redraw;
+	d->frame_redraw = 0;
+	int ok = emit_output(d, d->frame_commit);
+	d->frame_commit = 0;
+	d->frame_held = 0;
+	d->last_frame = now_ms();
+	return ok;
+}
+
+int min_timeout(int a, int b) { return a < 0 || (b >= 0 && b < a) ? b : a; }
+
+int frame_timeout(driver_t *d) {
+	if (!d->frame_held) return -1;
+	long long left = d->last_frame + d->frame_ms - now_ms();
+	return left > 0 ? (int)left : 0;
+}
+
+int frame_tick(driver_t *d, int force) {
+	if (!d->frame_held || (!force && frame_timeout(d) > 0)) return 1;
+	size_t commit_len = d->frame_commit;
+	int ok = frame_show(d);
+	stats_record(commit_len);
+	return ok;
+}
+
+// Show the update in current_output, whose first commit_len bytes are
+// committed (see emit_output()), or hold it until the next frame is due.
+// Only the latest window is kept; commit renders of replaced ones stay in
+// front of it, since the committed output is never rendered again.
+// Returns 1 on success, 0 on failure
+int frame_submit(driver_t *d, size_t commit_len) {
+	if (d->frame_ms == 0) return emit_output(d, commit_len);
+
+	buffer_t *cur = &d->current_output;
+	if (d->frame_commit == 0) {
+		buffer_swap(cur, &d->frame);  // Replaces the held window, if any
+	} else {
+		d->frame.len = d->frame_commit;
+		if (!buffer_append(&d->frame, cur->data, cur->len)) return 0;
+	}
+	buffer_reset(cur);
+	d->frame_commit += commit_len;
+	d->frame_fence = d->window_fence;
+	d->frame_redraw |= d->window_redraw;
+	d->frame_held = 1;
+	if (frame_timeout(d) == 0) return frame_show(d);
+	stats.branch = "held";
+	return 1;
+}
@@ -0,0 +1,79 @@
+#include "shown.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "term.h"
+
+static hash128_t line_hash(const char *data, size_t len) {
+	hash_state_t h;
+	hash_init(&h);
+	hash_update(&h, data, len);
+	return hash_final(&h);
+}
+
+void shown_truncate(shown_t *s, size_t count) {
+	for (; s->count > count; s->count--) {
+		s->len -= s->lines[s->count - 1].len;
+	}
+	s->partial = 0;  // Every line but the last ends with a newline
+}
+
+int shown_index(shown_t *s, const char *data, size_t len) {
+	size_t pos = 0;
+	while (pos < len) {
+		const char *nl = memchr(data + pos, '\n', len - pos);
+		size_t line_len = nl ? (size_t)(nl - data) + 1 - pos : len - pos;
+		if (s->count == s->capacity) {
+			size_t capacity = s->capacity ? s->capacity * 2 : 256;
+			shown_line_t *lines =
+			    realloc(s->lines, capacity * sizeof(*lines));
+			if (!lines) {
+				perror("realloc failed in shown_index");
+				return 0;
+			}
+			s->lines = lines;
+			s->capacity = capacity;
+		}
+		s->lines[s->count++] = (shown_line_t){
+		    .hash = line_hash(data + pos, line_len),
+		    .len = line_len,
+		    .cols = display_columns(data + pos, line_len),
+		};
+		s->len += line_len;
+		s->partial = !nl;
+		pos += line_len;
+	}
+	return 1;
+}
+
+size_t shown_match(const shown_t *s, const char *data, size_t len,
+                   size_t *line_start) {
+	size_t pos = 0;
+	size_t i = 0;
+	for (; i < s->count; i++) {
+		const shown_line_t *line = &s->lines[i];
+		if (line->len > len - pos) break;
+		hash128_t h = line_hash(data + pos, line->len);
+		if (h.a != line->hash.a || h.b != line->hash.b) break;
+		pos += line->len;
+	}
+	*line_start = pos;
+	return i;
+}
+
+int shown_rows(const shown_t *s, size_t first, int limit, int columns) {
+	int rows = 0;
+	for (size_t i = s->count; i > first; i--) {
+		rows += rows_for_columns(s->lines[i - 1].cols, columns);
+		if (i < s->count || !s->partial) rows++;  // Its newline
+		if (rows > limit) break;
+	}
+	return rows;
+}
+
+void shown_free(shown_t *s) {
+	free(s->lines);
+	*s = (shown_t){0};
+}
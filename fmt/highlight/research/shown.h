@@ -0,0 +1,46 @@
+#ifndef HL_SHOWN_H
+#define HL_SHOWN_H
+
+#include <stddef.h>  // For size_t
+
+#include "hash.h"
+
+// What is left of the uncommitted output once it is on the screen: per line
+// (split after each '\n'), enough to tell whether a new render starts with
+// it and how many rows it takes at any width, instead of the output itself
+
+typedef struct {
+	hash128_t hash;
+	size_t len;   // Bytes, with its newline; only the last may have none
+	size_t cols;  // Unwrapped, see display_columns()
+} shown_line_t;
+
+typedef struct {
+	shown_line_t *lines;
+	size_t count;
+	size_t capacity;
+	size_t len;   // Bytes of all of them
+	int partial;  // The last line has no newline yet
+} shown_t;
+
+// Keep only the first count lines
+void shown_truncate(shown_t *s, size_t count);
+
+// Add the lines of data, which goes on from where shown ends
+// Returns 1 on success, 0 on allocation failure
+int shown_index(shown_t *s, const char *data, size_t len);
+
+// How many of the shown lines data starts with; *line_start is where the
+// first one that differs starts in data
+size_t shown_match(const shown_t *s, const char *data, size_t len,
+                   size_t *line_start);
+
+// Rows the cursor moves down while the shown lines from first on are
+// printed from column 0. Counted from the end back, stopping once past
+// limit: only what fits on the screen is ever counted, however long the
+// window is.
+int shown_rows(const shown_t *s, size_t first, int limit, int columns);
+
+void shown_free(shown_t *s);
+
+#endif
@@ -0,0 +1,86 @@
+#define _POSIX_C_SOURCE 200809L
+#include "stats.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "io.h"
+
+stats_t stats;
+
+long long now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+long long stats_clock(void) {
+	if (!stats.enabled) return 0;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void stats_since(long long *total, long long start) {
+	if (stats.enabled) *total += stats_clock() - start;
+}
+
+void stats_init(int requested) {
+	const char *path = getenv("HLMD_STATS");
+	stats.fd = -1;
+	if (path && *path) {
+		int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (fd == -1) {
+			perror("Failed to open HLMD_STATS");
+		} else {
+			stats.fd = fd;
+			requested = 1;
+		}
+	}
+	stats.enabled = requested;
+	buffer_init(&stats.records);
+	stats.start_us = stats_clock();
+}
+
+void stats_record(size_t commit_len) {
+	if (!stats.enabled) return;
+	char line[512];
+	int n = snprintf(
+	    line, sizeof(line),
+	    "{\"iter\":%d,\"t_us\":%lld,\"renders\":%d,\"input\":%zu,"
+	    "\"output\":%zu,\"stdout\":%zu,\"commit\":%zu,\"branch\":\"%s\","
+	    "\"spawn_us\":%lld,\"write_us\":%lld,\"read_us\":%lld,"
+	    "\"diff_us\":%lld,\"stdout_us\":%lld,\"dropped\":%d,"
+	    "\"avoided\":%d}\n",
+	    stats.iteration++, stats_clock() - stats.start_us, stats.renders,
+	    stats.input_bytes, stats.output_bytes, stats.stdout_bytes, commit_len,
+	    stats.branch ? stats.branch : "none", stats.spawn_us, stats.write_us,
+	    stats.read_us, stats.diff_us, stats.stdout_us, stats.dropped,
+	    stats.avoided);
+	if (n > 0 && (size_t)n < sizeof(line)) {
+		if (stats.fd >= 0) {
+			write_all(stats.fd, line, n);
+		} else {
+			buffer_append(&stats.records, line, n);
+		}
+	}
+
+	stats.spawn_us = stats.write_us = stats.read_us = 0;
+	stats.diff_us = stats.stdout_us = 0;
+	stats.renders = stats.dropped = stats.avoided = 0;
+	stats.input_bytes = stats.output_bytes = stats.stdout_bytes = 0;
+	stats.branch = NULL;
+}
+
+void stats_finish(void) {
+	if (!stats.enabled) return;
+	if (stats.fd >= 0) {
+		close(stats.fd);
+	} else {
+		write_all(STDERR_FILENO, stats.records.data, stats.records.len);
+	}
+	buffer_free(&stats.records);
+}
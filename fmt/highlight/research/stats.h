@@ -0,0 +1,55 @@
+#ifndef HL_STATS_H
+#define HL_STATS_H
+
+#include <stddef.h>  // For size_t
+
+#include "buffer.h"
+
+// Where each update's time goes, for --stats / HLMD_STATS. One record per
+// update, written as a JSON line: directly to HLMD_STATS (a path, e.g.
+// /dev/fd/3) as it happens, or kept in memory and sent to stderr on exit.
+// Instrumentation is process-wide, so it is one global instead of being
+// threaded through every render call.
+typedef struct {
+	int enabled;
+	int fd;            // HLMD_STATS file, -1 to keep records until exit
+	buffer_t records;  // JSON lines waiting for exit
+	long long start_us;
+	int iteration;
+
+	// Current update, reset once its record is out
+	long long spawn_us;   // pipe() + fork() of per-render highlighters
+	long long write_us;   // Until the child took all its input
+	long long read_us;    // From there until its output was complete
+	long long diff_us;    // Comparing against what is on screen
+	long long stdout_us;  // write()s to stdout
+	int renders;
+	size_t input_bytes;   // Sent to the highlighter
+	size_t output_bytes;  // Received from it
+	size_t stdout_bytes;  // Written to stdout, tee()d bytes included
+	int dropped;          // Pipelined renders thrown away since the last one
+	int avoided;          // Fences shown provisionally that closed in place
+	const char *branch;   // first, suffix, repaint, rewrite, held, plain...
+} stats_t;
+
+extern stats_t stats;
+
+// Milliseconds on a monotonic clock
+long long now_ms(void);
+
+// Microseconds on a monotonic clock, 0 when stats are off
+long long stats_clock(void);
+
+// Add the time since start (from stats_clock()) to *total
+void stats_since(long long *total, long long start);
+
+// Enable stats if --stats was given or HLMD_STATS is set
+void stats_init(int requested);
+
+// Emit the current update's record and start the next one
+void stats_record(size_t commit_len);
+
+// Flush records kept for exit and close HLMD_STATS
+void stats_finish(void);
+
+#endif
@@ -0,0 +1,70 @@
+#include "term.h"
+
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+size_t utf8_safe_end(const char *data, size_t start, size_t end) {
+	size_t lead = end;
+	while (lead > start && lead > end - 4 &&
+	       ((unsigned char)data[lead - 1] & 0xC0) == 0x80) {
+		lead--;
+	}
+	if (lead == start) return end;  // Only continuation bytes, leave as is
+
+	unsigned char c = (unsigned char)data[lead - 1];
+	size_t need = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+	return end - (lead - 1) >= need ? end : lead - 1;
+}
+
+void terminal_size(int *columns, int *rows) {
+	struct winsize ws;
+	int ok = ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0;
+	*columns = ok && ws.ws_col > 0 ? ws.ws_col : 80;
+	*rows = ok && ws.ws_row > 0 ? ws.ws_row : 24;
+}
+
+size_t display_columns(const char *text, size_t len) {
+	size_t cols = 0;
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)text[i];
+		if (c == '\033' && i + 1 < len && text[i + 1] == '[') {
+			i += 2;
+			while (i < len && ((unsigned char)text[i] < 0x40 ||
+			                   (unsigned char)text[i] > 0x7E)) {
+				i++;
+			}
+		} else if (c == '\t') {
+			cols = (cols / 8 + 1) * 8;
+		} else if ((c & 0xC0) != 0x80 && c >= 0x20) {
+			cols++;
+		}
+	}
+	return cols;
+}
+
+int rows_for_columns(size_t cols, int columns) {
+	return cols > 0 ? (int)((cols - 1) / columns) : 0;
+}
+
+// Extra rows of a rendered line
+static int wrapped_rows(const char *text, size_t len, int columns) {
+	return rows_for_columns(display_columns(text, len), columns);
+}
+
+size_t tail_for_rows(const char *text, size_t len, int max_rows,
+                     int columns) {
+	size_t start = len;
+	while (start > 0 && text[start - 1] != '\n') start--;
+	int rows = wrapped_rows(text + start, len - start, columns);
+
+	while (start > 0) {
+		size_t prev = start - 1;  // The '\n' ending the line before
+		while (prev > 0 && text[prev - 1] != '\n') prev--;
+		int line_rows =
+		    wrapped_rows(text + prev, start - 1 - prev, columns) + 1;
+		if (rows + line_rows > max_rows) break;
+		rows += line_rows;
+		start = prev;
+	}
+	return start;
+}
@@ -0,0 +1,28 @@
+#ifndef HL_TERM_H
+#define HL_TERM_H
+
+#include <stddef.h>  // For size_t
+
+// What rendered output looks like on the terminal: its size, and how many
+// rows a line takes once it wraps
+
+// Cut a byte range so it does not end inside a UTF-8 sequence
+size_t utf8_safe_end(const char *data, size_t start, size_t end);
+
+// Size of the stdout tty, 80x24 if unknown
+void terminal_size(int *columns, int *rows);
+
+// Columns a rendered line spans before wrapping. Skips CSI escape
+// sequences; counts one column per UTF-8 code point.
+size_t display_columns(const char *text, size_t len);
+
+// Number of extra terminal rows a line of cols columns occupies after
+// wrapping
+int rows_for_columns(size_t cols, int columns);
+
+// Start of the earliest line from which the rest of text spans at most
+// max_rows rows (never later than the start of the last line)
+size_t tail_for_rows(const char *text, size_t len, int max_rows,
+                     int columns);
+
+#endif